@@ -0,0 +1,718 @@
+// Бенчмарки бібліотеки: кожен відтворює вимірювання зі свого запиту.
+// Запуск: library_bench [назва...] [--scale=K]; розміри множаться на K (за замовчуванням 1)
+#include "../main.cpp"
+#include <chrono>
+#include <random>
+#ifdef __unix__
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+using Clock = chrono::steady_clock;
+size_t scale = 1;
+string selfPath;   // шлях до бінарника бенчу, для дочірніх процесів
+
+double secondsSince(Clock::time_point start) { return chrono::duration<double>(Clock::now() - start).count(); }
+
+template<typename F>
+double timeIt(F f) {
+    auto start = Clock::now();
+    f();
+    return secondsSince(start);
+}
+
+// Перцентиль затримок у мікросекундах
+double percentile(vector<double> us, double p) {
+    if (us.empty()) return 0;
+    sort(us.begin(), us.end());
+    return us[min(us.size() - 1, (size_t)(us.size() * p))];
+}
+
+void fillCatalog(Catalog& c, size_t n, int firstId = 1) {
+    for (size_t i = 0; i < n; ++i) {
+        int id = firstId + (int)i;
+        string title = "Title " + to_string(i * 7919 % n), author = "Author " + to_string(i % 997);
+        int year = 1950 + (int)(i % 70);
+        const char* genre = fixedGenres[i % fixedGenreCount];
+        if (i % 3 == 0) c.addBook(PrintedBook(id, title, Author(author), year, genre, 50 + (int)(i % 900)));
+        else if (i % 3 == 1) c.addBook(EBook(id, title, Author(author), year, genre, 0.5 + i % 40));
+        else c.addBook(AudioBook(id, title, Author(author), year, genre, 1.0 + i % 25));
+    }
+}
+
+size_t residentBytes() {
+#ifdef __linux__
+    ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    statm >> pages >> resident;
+    return resident * (size_t)sysconf(_SC_PAGESIZE);
+#else
+    return 0;
+#endif
+}
+
+// Байти, виділені через malloc і ще не звільнені; 0, якщо glibc недоступна.
+// На відміну від RSS не залежить від того, чи аллокатор уже мав вільні сторінки
+size_t heapInUse() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+void row(const string& what, double value, const string& unit) {
+    cout << "  " << left << setw(52) << what << right << setw(14) << fixed << setprecision(3) << value << ' ' << unit << '\n';
+}
+
+// ===== user-101 =====
+void benchTiering() {
+    size_t n = 200000 * scale;
+    Catalog c;
+    fillCatalog(c, n);
+    size_t before = residentBytes();
+    size_t moved = c.tierCold("bench_tiering.seg", 1);
+    size_t retained = residentBytes();
+    c.tierCold("bench_tiering.seg", 1);   // наступний прохід звільняє відкріплені копії
+    size_t after = residentBytes();
+    row("books moved to disk", (double)moved, "");
+    row("RSS change after the tiering pass", ((double)before - (double)retained) / (1 << 20), "MiB freed");
+    row("RSS change after the next pass", ((double)before - (double)after) / (1 << 20), "MiB freed");
+    mt19937 rng(1);
+    vector<double> cold, hot;
+    for (int i = 0; i < 2000; ++i) {
+        int id = 1 + (int)(rng() % n);
+        auto s = Clock::now();
+        c.findById(id);
+        cold.push_back(secondsSince(s) * 1e6);
+        s = Clock::now();
+        c.findById(id);
+        hot.push_back(secondsSince(s) * 1e6);
+    }
+    row("cold lookup p50", percentile(cold, 0.5), "us");
+    row("cold lookup p99", percentile(cold, 0.99), "us");
+    row("hot lookup p50", percentile(hot, 0.5), "us");
+    uint64_t first = c.segmentBytes();
+    for (int cycle = 0; cycle < 5; ++cycle) {
+        for (size_t id = 1; id <= n; id += 2) c.findById((int)id);
+        c.tierCold("bench_tiering.seg", 100);
+        c.reclaim();
+    }
+    row("segment size after 5 fault-in/tier cycles", (double)c.segmentBytes() / first, "x first");
+    remove("bench_tiering.seg");
+}
+
+// ===== user-102 =====
+void benchAsOf() {
+    Library lib;
+    size_t n = 2000;
+    for (size_t i = 1; i <= n; ++i) lib.addBook(PrintedBook((int)i, "B", Author("a"), 2000, "Drama", 1));
+    UserRow l = lib.addLibrarian("l", "E");
+    time_t t = 0;
+    for (int round = 0; round < 50 * (int)scale; ++round)
+        for (size_t i = 1; i <= n; ++i) { lib.checkout(l, (int)i, ++t); lib.checkin(l, (int)i, ++t); }
+    size_t queries = 1000000;
+    mt19937 rng(2);
+    size_t hits = 0;
+    double sec = timeIt([&] { for (size_t q = 0; q < queries; ++q) hits += lib.wasAvailable(1 + (int)(rng() % n), (time_t)(rng() % t)); });
+    row("versions per book", (double)t / n, "");
+    row("as-of availability query", sec / queries * 1e9, "ns");
+    row("as-of loan count query", timeIt([&] { for (size_t q = 0; q < queries; ++q) hits += lib.borrowedAt(l, (time_t)(rng() % t)); }) / queries * 1e9, "ns");
+    if (hits == 42) cout << "";
+}
+
+// ===== user-103 =====
+// Дочірній процес старту: завантаження каталогу й перший пошук; результат — один рядок у stdout
+int startupChild(bool lazy, size_t n) {
+    Catalog c;
+    fillCatalog(c, n);
+    c.startWarming({IndexField::Title, IndexField::Author, IndexField::Genre});
+    if (!lazy) c.waitForIndexBuilds();
+    cout << c.findBy(IndexField::Title, "Title 5").size() << endl;
+    return 0;
+}
+
+// Від fork/exec бінарника до першого результату пошуку в батьківському процесі
+void benchStartup() {
+#ifdef __unix__
+    string count = to_string(300000 * scale);
+    for (const char* mode : {"lazy", "eager"}) {
+        int fds[2];
+        if (pipe(fds) != 0) return;
+        auto start = Clock::now();
+        pid_t pid = fork();
+        if (pid == 0) {
+            dup2(fds[1], STDOUT_FILENO);
+            close(fds[0]);
+            close(fds[1]);
+            execl(selfPath.c_str(), selfPath.c_str(), "--startup-child", mode, count.c_str(), (char*)nullptr);
+            _exit(127);
+        }
+        close(fds[1]);
+        char buf[32];
+        ssize_t got = pid > 0 ? read(fds[0], buf, sizeof buf) : -1;
+        double ms = secondsSince(start) * 1e3;
+        close(fds[0]);
+        if (pid > 0) waitpid(pid, nullptr, 0);
+        if (got <= 0) {
+            cout << "  startup child failed\n";
+            continue;
+        }
+        row(string(mode) == "lazy" ? "launch to first search, lazy + warming" : "launch to first search, eager indexes", ms, "ms");
+    }
+#else
+    cout << "  needs fork/exec\n";
+#endif
+}
+
+// ===== user-104 =====
+void benchSort() {
+    size_t n = 1000000 * scale;
+    mt19937 rng(4);
+    vector<string> keys(n);
+    for (auto& k : keys) k = collationKey("Title " + to_string(rng() % n) + " of the " + to_string(rng() % 1000));
+    vector<size_t> order;
+    row("parallel MSD radix sort", timeIt([&] { order = parallelRadixSort(keys); }), "s");
+    vector<string> copy = keys;
+    row("std::sort with string compare", timeIt([&] { sort(copy.begin(), copy.end()); }), "s");
+    row("keys", (double)n, "");
+}
+
+// ===== user-105 =====
+void benchAudit() {
+    for (int on = 0; on <= 1; ++on) {
+        AuditConfig cfg;
+        cfg.prefix = "bench_audit";
+        AuditLog audit(cfg);
+        Library lib;
+        if (on) lib.setAudit(&audit);
+        size_t n = 20000 * scale;
+        for (size_t i = 1; i <= n; ++i) lib.addBook(PrintedBook((int)i, "B", Author("a"), 2000, "Drama", 1));
+        UserRow l = lib.addLibrarian("librarian", "E");
+        vector<double> us;
+        for (size_t i = 1; i <= n; ++i) {
+            auto s = Clock::now();
+            lib.checkout(l, (int)i);
+            us.push_back(secondsSince(s) * 1e6);
+        }
+        row(on ? "checkout p99, audit on" : "checkout p99, audit off", percentile(us, 0.99), "us");
+        row(on ? "checkout p50, audit on" : "checkout p50, audit off", percentile(us, 0.5), "us");
+    }
+    for (int i = 0; i < 16; ++i) remove(("bench_audit." + to_string(i) + ".log").c_str());
+}
+
+// ===== user-106 =====
+void benchBloom() {
+    size_t n = 100000 * scale;
+    PartitionedCatalog pc(16);
+    for (size_t i = 1; i <= n; ++i) pc.addBook(PrintedBook((int)i, "Title " + to_string(i), Author("Author " + to_string(i)), 2000, "Drama", 1));
+    mt19937 rng(6);
+    size_t queries = 20000;
+    double sec = timeIt([&] { for (size_t q = 0; q < queries; ++q) pc.findBy(IndexField::Title, "Title " + to_string(1 + rng() % n)); });
+    row("partitions", (double)pc.partitionCount(), "");
+    row("average partitions contacted per query", pc.averageFanOut(), "");
+    row("routed lookup latency", sec / queries * 1e6, "us");
+}
+
+// ===== user-107 =====
+void benchGenre() {
+    size_t n = 1000000 * scale;
+    vector<string> raw(n);
+    for (size_t i = 0; i < n; ++i) raw[i] = fixedGenres[i * 31 % fixedGenreCount];
+    vector<GenreCode> codes(n);
+    row("genre parse (constexpr table)", timeIt([&] { for (size_t i = 0; i < n; ++i) codes[i] = genreCode(raw[i]); }) / n * 1e9, "ns/book");
+    GenreCode drama = genreCode("Drama");
+    size_t a = 0, b = 0;
+    row("filter by genre code", timeIt([&] { for (GenreCode c : codes) a += c == drama; }) / n * 1e9, "ns/book");
+    row("filter by genre string", timeIt([&] { for (const string& s : raw) b += s == "Drama"; }) / n * 1e9, "ns/book");
+    if (a != b) cout << "  mismatch\n";
+}
+
+// ===== user-108 =====
+void benchGetMany() {
+    size_t n = 1000000 * scale;
+    Catalog c;
+    fillCatalog(c, n);
+    mt19937 rng(8);
+    for (size_t batch : {50, 100, 500}) {
+        vector<int> ids(batch);
+        size_t rounds = 2000;
+        double seq = 0, many = 0;
+        for (size_t r = 0; r < rounds; ++r) {
+            for (int& id : ids) id = 1 + (int)(rng() % n);
+            seq += timeIt([&] { for (int id : ids) c.findById(id); });
+            many += timeIt([&] { c.getMany(ids); });
+        }
+        row("batch " + to_string(batch) + ": sequential findById", seq / rounds / batch * 1e9, "ns/id");
+        row("batch " + to_string(batch) + ": getMany", many / rounds / batch * 1e9, "ns/id");
+    }
+}
+
+// ===== user-109 =====
+void benchZoneMaps() {
+    size_t n = 500000 * scale;
+    Catalog c;
+    mt19937 rng(9);
+    for (size_t i = 1; i <= n; ++i)
+        c.addBook(PrintedBook((int)i, "T", Author("A"), 1900 + (int)(rng() % 120), fixedGenres[rng() % fixedGenreCount], 100));
+    ScanFilter f;
+    f.yearMin = 2000;
+    f.yearMax = 2001;
+    f.genre = genreCode("Drama");
+    size_t found = 0;
+    row("selective scan, unclustered", timeIt([&] { for (int i = 0; i < 10; ++i) found = c.scan(f).size(); }) / 10 * 1e3, "ms");
+    c.cluster();
+    row("selective scan, clustered", timeIt([&] { for (int i = 0; i < 10; ++i) found = c.scan(f).size(); }) / 10 * 1e3, "ms");
+    row("matching books", (double)found, "");
+}
+
+// ===== user-110 =====
+void benchColumns() {
+    size_t n = 1000000 * scale;
+    Catalog c;
+    fillCatalog(c, n);
+    ColumnStore store(c);
+    size_t plain = n * (sizeof(int) * 2 + sizeof(bool) + sizeof(uint8_t) + sizeof(string));
+    row("plain columns (id, year, available, type, genre)", (double)plain / (1 << 20), "MiB");
+    row("encoded columns", (double)store.bytes() / (1 << 20), "MiB");
+    ScanFilter f;
+    f.yearMin = 1990;
+    f.yearMax = 1999;
+    f.genre = genreCode("History");
+    size_t hits = 0;
+    row("encoded scan", timeIt([&] { for (int i = 0; i < 10; ++i) hits += store.select(f).size(); }) / 10 * 1e3, "ms");
+    row("row scan", timeIt([&] { for (int i = 0; i < 10; ++i) hits += c.scan(f).size(); }) / 10 * 1e3, "ms");
+}
+
+// ===== user-111 =====
+void benchSharded() {
+    const size_t clients = 4, books = 20000, perClient = 50000 * scale;
+    ShardedLibrary sl(4, clients);
+    for (int id = 1; id <= (int)books; ++id) sl.addBook(0, PrintedBook(id, "B", Author("a"), 2000, "Drama", 1));
+    vector<int> users;
+    for (size_t i = 0; i < 1000; ++i) users.push_back(sl.addStudent(0, "s" + to_string(i), "F", 1));
+    ShardedLibrary::wait(*sl.borrow(0, users[0], 1));
+    ShardedLibrary::wait(*sl.giveBack(0, users[0], 1));
+    vector<vector<double>> lat(clients);
+    double sec = timeIt([&] {
+        vector<thread> pool;
+        for (size_t c = 0; c < clients; ++c)
+            pool.emplace_back([&, c] {
+                mt19937 rng((unsigned)c);
+                for (size_t k = 0; k < perClient; ++k) {
+                    int u = users[rng() % users.size()], b = 1 + (int)(rng() % books);
+                    auto s = Clock::now();
+                    if (ShardedLibrary::wait(*sl.borrow(c, u, b))) ShardedLibrary::wait(*sl.giveBack(c, u, b));
+                    lat[c].push_back(secondsSince(s) * 1e6);
+                }
+            });
+        for (auto& t : pool) t.join();
+    });
+    vector<double> all;
+    for (auto& l : lat) all.insert(all.end(), l.begin(), l.end());
+    row("sharded: borrow+return pairs/s", clients * perClient / sec, "");
+    row("sharded: p99", percentile(all, 0.99), "us");
+
+    Library lib;
+    mutex m;
+    for (int id = 1; id <= (int)books; ++id) lib.addBook(PrintedBook(id, "B", Author("a"), 2000, "Drama", 1));
+    vector<UserRow> students;
+    for (size_t i = 0; i < 1000; ++i) students.push_back(lib.addStudent("s" + to_string(i), "F", 1));
+    for (auto& l : lat) l.clear();
+    sec = timeIt([&] {
+        vector<thread> pool;
+        for (size_t c = 0; c < clients; ++c)
+            pool.emplace_back([&, c] {
+                mt19937 rng((unsigned)c);
+                for (size_t k = 0; k < perClient; ++k) {
+                    UserRow u = students[rng() % students.size()];
+                    int b = 1 + (int)(rng() % books);
+                    auto s = Clock::now();
+                    {
+                        lock_guard<mutex> lock(m);
+                        if (lib.checkout(u, b)) lib.checkin(u, b);
+                    }
+                    lat[c].push_back(secondsSince(s) * 1e6);
+                }
+            });
+        for (auto& t : pool) t.join();
+    });
+    all.clear();
+    for (auto& l : lat) all.insert(all.end(), l.begin(), l.end());
+    row("locked Library: borrow+return pairs/s", clients * perClient / sec, "");
+    row("locked Library: p99", percentile(all, 0.99), "us");
+}
+
+// ===== user-112 =====
+void benchPipeline() {
+    size_t n = 100000 * scale;
+    vector<string> lines;
+    for (size_t i = 0; i < n / 10; ++i) lines.push_back("book|P|T" + to_string(i) + "|A|2000|Drama|100");
+    for (size_t i = 0; i < 100; ++i) lines.push_back("student|s" + to_string(i) + "|F|1");
+    while (lines.size() < n) {
+        size_t i = lines.size();
+        lines.push_back(string(i % 2 ? "return" : "borrow") + "|s" + to_string(i / 2 % 100) + "|" + to_string(1 + i / 2 % (n / 10)));
+    }
+    {
+        Library lib;
+        ofstream log("bench_pipeline.log");
+        atomic<size_t> done{0};
+        double sec = timeIt([&] {
+            MutationPipeline p(lib, log, [&](uint64_t, bool, const string&) { done++; });
+            for (const string& l : lines) p.submit(l);
+            p.close();
+        });
+        row("pipeline: mutations/s", n / sec, "");
+    }
+    {
+        // Послідовний шлях: розбір, перевірка, застосування й запис з flush на кожен запит
+        Library lib;
+        ofstream log("bench_pipeline.log");
+        double sec = timeIt([&] {
+            uint64_t seq = 0;
+            for (const string& l : lines) {
+                vector<string> f;
+                size_t start = 0, bar;
+                while ((bar = l.find('|', start)) != string::npos) { f.push_back(l.substr(start, bar - start)); start = bar + 1; }
+                f.push_back(l.substr(start));
+                bool ok = false;
+                if (f[0] == "book") { lib.addBook(PrintedBook(lib.newBookId(), f[2], Author(f[3]), stoi(f[4]), f[5], stoi(f[6]))); ok = true; }
+                else if (f[0] == "student") { lib.addStudent(f[1], f[2], stoi(f[3])); ok = true; }
+                else {
+                    UserRow u = lib.findUser(f[1]);
+                    ok = f[0] == "borrow" ? lib.checkout(u, stoi(f[2])) : lib.checkin(u, stoi(f[2]));
+                }
+                if (ok) { log << seq << ' ' << l << '\n'; log.flush(); }
+                seq++;
+            }
+        });
+        row("per-request path: mutations/s", n / sec, "");
+    }
+    remove("bench_pipeline.log");
+}
+
+// ===== user-113 =====
+void benchMetrics() {
+    Catalog c;
+    fillCatalog(c, 100000 * scale);
+    GaugeRegistration gauges = registerCatalogGauges(c);
+    size_t bytes = 0;
+    row("render /metrics body", timeIt([&] { for (int i = 0; i < 1000; ++i) bytes += Metrics::instance().render().size(); }) / 1000 * 1e6, "us");
+    mt19937 rng(13);
+    size_t lookups = 1000000;
+    row("findById with latency histogram", timeIt([&] { for (size_t i = 0; i < lookups; ++i) c.findById(1 + (int)(rng() % 100000)); }) / lookups * 1e9, "ns");
+    row("metrics body size", (double)bytes / 1000, "bytes");
+}
+
+// ===== user-115 =====
+void benchSearchType() {
+    size_t n = 1000000 * scale;
+    Catalog c;
+    fillCatalog(c, n);
+    size_t a = 0, b = 0;
+    row("searchType<AudioBook>(duration > 10)", timeIt([&] {
+        a = c.searchType<AudioBook>([](const AudioBook& x) { return x.getDuration() > 10; }).size();
+    }) * 1e3, "ms");
+    row("search() with type check and downcast", timeIt([&] {
+        b = c.search([](const Book& x) { auto* p = dynamic_cast<const AudioBook*>(&x); return p && p->getDuration() > 10; }).size();
+    }) * 1e3, "ms");
+    if (a != b) cout << "  mismatch\n";
+}
+
+// ===== user-116 =====
+void benchCoalescing() {
+    Catalog c;
+    fillCatalog(c, 200000 * scale);
+    const size_t threads = 64;
+    for (int coalesce = 1; coalesce >= 0; --coalesce) {
+        SearchService service(c, 1024, chrono::milliseconds(coalesce ? 500 : 0));
+        auto before = Metrics::instance().totals(Operation::Search).first;
+        vector<double> us(threads);
+        vector<thread> pool;
+        for (size_t t = 0; t < threads; ++t)
+            pool.emplace_back([&, t] {
+                auto s = Clock::now();
+                if (coalesce) service.find(IndexField::Author, "Author 17");
+                else c.findBy(IndexField::Author, "Author 17");
+                us[t] = secondsSince(s) * 1e6;
+            });
+        for (auto& t : pool) t.join();
+        auto executed = Metrics::instance().totals(Operation::Search).first - before;
+        row(coalesce ? "herd of 64, coalesced: backend executions" : "herd of 64, direct: backend executions", (double)executed, "");
+        row(coalesce ? "herd of 64, coalesced: p99" : "herd of 64, direct: p99", percentile(us, 0.99), "us");
+    }
+}
+
+// ===== user-117 =====
+void benchEytzinger() {
+    size_t n = 4000000 * scale;
+    mt19937 rng(17);
+    vector<pair<int, uint32_t>> entries(n);
+    for (size_t i = 0; i < n; ++i) entries[i] = make_pair((int)(rng() % (n * 4)), (uint32_t)i);
+    EytzingerIndex<int> index(entries);
+    vector<int> sorted;
+    for (auto& e : entries) sorted.push_back(e.first);
+    sort(sorted.begin(), sorted.end());
+    map<int, uint32_t> tree(entries.begin(), entries.end());
+    vector<int> probes(1000000);
+    for (int& p : probes) p = (int)(rng() % (n * 4));
+    size_t sink = 0;
+    row("Eytzinger lowerBound", timeIt([&] { for (int p : probes) sink += index.lowerBound(p); }) / probes.size() * 1e9, "ns");
+    row("std::lower_bound on sorted vector", timeIt([&] { for (int p : probes) sink += lower_bound(sorted.begin(), sorted.end(), p) - sorted.begin(); }) / probes.size() * 1e9, "ns");
+    row("std::map::lower_bound (dynamic tree)", timeIt([&] { for (int p : probes) sink += tree.lower_bound(p) != tree.end(); }) / probes.size() * 1e9, "ns");
+    if (sink == 1) cout << "";
+}
+
+// ===== user-118 =====
+void benchCracking() {
+    size_t n = 500000 * scale;
+    Catalog c;
+    fillCatalog(c, n);
+    mt19937 rng(18);
+    vector<pair<double, double>> queries;
+    for (int q = 0; q < 200; ++q) { double lo = 1950 + rng() % 70; queries.emplace_back(lo, lo + rng() % 3); }
+    size_t hits = 0;
+    double cracked = 0, scanned = 0;
+    for (auto& q : queries) {
+        cracked += timeIt([&] { hits += c.crackRange(NumericField::Year, q.first, q.second).size(); });
+        scanned += timeIt([&] { hits += c.search([&](const Book& b) { return b.getYear() >= q.first && b.getYear() <= q.second; }).size(); });
+    }
+    double upfront = timeIt([&] { c.freeze(); });
+    for (auto& q : queries) upfront += timeIt([&] { hits += c.yearRange((int)q.first, (int)q.second).size(); });
+    row("200 range queries, cracking (cumulative)", cracked * 1e3, "ms");
+    row("200 range queries, full scans (cumulative)", scanned * 1e3, "ms");
+    row("200 range queries, index built upfront (incl. build)", upfront * 1e3, "ms");
+}
+
+// ===== user-119 =====
+void benchLearned() {
+    size_t n = 2000000 * scale;
+    Catalog c;
+    fillCatalog(c, n);
+    mt19937 rng(19);
+    vector<int> probes(500000);
+    for (int& p : probes) p = 1 + (int)(rng() % n);
+    row("hash id table: lookup", timeIt([&] { for (int id : probes) c.findById(id); }) / probes.size() * 1e9, "ns");
+    row("hash id table: memory", (double)c.stats().idTableBytes.load() / (1 << 20), "MiB");
+    // Упорядкована база: std::map (червоно-чорне дерево, та сама роль, що й B-дерево) id → позиція
+    size_t heapBefore = heapInUse();
+    map<int, uint32_t> tree;
+    for (size_t i = 0; i < n; ++i) tree.emplace((int)i + 1, (uint32_t)i);
+    row("std::map id tree: memory", ((double)heapInUse() - (double)heapBefore) / (1 << 20), "MiB");
+    size_t sink = 0;
+    row("std::map id tree: lookup", timeIt([&] { for (int id : probes) sink += tree.find(id)->second; }) / probes.size() * 1e9, "ns");
+    if (sink == 1) cout << "";
+    row("learned index: build", timeIt([&] { c.useLearnedIndexes(true); }) * 1e3, "ms");
+    row("learned index: lookup", timeIt([&] { for (int id : probes) c.findById(id); }) / probes.size() * 1e9, "ns");
+    row("learned index: model memory (id + year)", (double)c.learnedModelBytes() / 1024, "KiB");
+}
+
+// ===== user-120 =====
+void benchSimulator() {
+    SimulationConfig cfg;
+    cfg.days = 120.0 * scale;
+    SimulationReport r = LibrarySimulator(cfg).run();
+    r.print(cout);
+}
+
+// ===== user-121 =====
+void benchFullText() {
+    string dir = "bench_fulltext";
+#ifdef __unix__
+    mkdir(dir.c_str(), 0755);
+#endif
+    size_t docs = 400 * scale;
+    mt19937 rng(21);
+    vector<string> vocabulary;
+    for (int i = 0; i < 20000; ++i) vocabulary.push_back("w" + to_string(i));
+    Catalog c;
+    for (size_t d = 1; d <= docs; ++d) {
+        ofstream out(dir + "/" + to_string(d) + ".txt");
+        for (int w = 0; w < 20000; ++w) out << vocabulary[min<size_t>(rng() % 20000, rng() % 20000)] << ' ';
+        c.addBook(EBook((int)d, "T", Author("A"), 2000, "Drama", 1));
+    }
+    ContentIndex index(c, dir);
+    double sec = timeIt([&] { index.indexCatalog(); });
+    row("indexing throughput", index.bytesIndexed() / sec * 3600 / 1e9, "GB/hour");
+    vector<double> us;
+    for (int q = 0; q < 200; ++q) {
+        string phrase = vocabulary[rng() % 50] + " " + vocabulary[rng() % 50];
+        auto s = Clock::now();
+        index.phrase(phrase);
+        us.push_back(secondsSince(s) * 1e6);
+    }
+    row("phrase query p50", percentile(us, 0.5), "us");
+    row("phrase query p99", percentile(us, 0.99), "us");
+    for (size_t d = 1; d <= docs; ++d) remove((dir + "/" + to_string(d) + ".txt").c_str());
+#ifdef __unix__
+    rmdir(dir.c_str());
+#endif
+}
+
+// ===== user-122 =====
+void benchTransfers() {
+    const size_t branches = 30;
+    vector<vector<double>> cost(branches, vector<double>(branches));
+    for (size_t i = 0; i < branches; ++i)
+        for (size_t j = 0; j < branches; ++j) cost[i][j] = i > j ? i - j : j - i;
+    TransferPlanner planner(cost);
+    for (size_t titles : {10000ul, 100000ul, 1000000ul * scale}) {
+        mt19937 rng(22);
+        vector<vector<TitleDemand>> snapshot(branches);
+        for (size_t t = 0; t < titles; ++t)
+            for (int k = 0; k < 4; ++k)
+                snapshot[rng() % branches].push_back(TitleDemand{"t" + to_string(t), (int)(rng() % 4), (int)(rng() % 4)});
+        vector<Transfer> plan;
+        double sec = timeIt([&] { plan = planner.plan(snapshot); });
+        row(to_string(titles) + " titles x 30 branches: solve", sec, "s");
+    }
+}
+
+// ===== user-123 =====
+void benchScheduler() {
+    size_t n = 200000 * scale;
+    Catalog c;
+    fillCatalog(c, n);
+    auto heavy = [&](uint64_t& io) {
+        vector<int> ids;
+        for (int i = 0; i < 2000; ++i) ids.push_back(i);
+        c.getMany(ids);
+        io += 1 << 16;
+        return true;
+    };
+    auto foreground = [&](const string& label) {
+        vector<double> us;
+        mt19937 rng(23);
+        auto end = Clock::now() + chrono::seconds(2);
+        while (Clock::now() < end) {
+            auto s = Clock::now();
+            c.findBy(IndexField::Title, "Title " + to_string(rng() % n));
+            us.push_back(secondsSince(s) * 1e6);
+            this_thread::sleep_for(chrono::microseconds(200));
+        }
+        row(label + ": foreground search p99", percentile(us, 0.99), "us");
+    };
+    c.findBy(IndexField::Title, "warm");
+    c.waitForIndexBuilds();
+    foreground("idle");
+    {
+        atomic<bool> stop{false};
+        vector<thread> pool;
+        for (int t = 0; t < 4; ++t) pool.emplace_back([&] { uint64_t io; while (!stop) heavy(io); });
+        foreground("unscheduled maintenance (4 threads)");
+        stop = true;
+        for (auto& t : pool) t.join();
+    }
+    {
+        MaintenanceScheduler scheduler(chrono::microseconds(50));
+        atomic<bool> stop{false};
+        for (int t = 0; t < 4; ++t)
+            scheduler.submit("heavy", MaintenancePriority::Normal, MaintenanceBudget(), [&](uint64_t& io) { heavy(io); return !stop; });
+        foreground("scheduled maintenance");
+        stop = true;
+    }
+}
+
+// ===== user-124 =====
+void benchUsers() {
+    size_t n = 1000000 * scale;
+    size_t before = heapInUse();
+    Library lib;
+    for (size_t i = 0; i < n; ++i) lib.addStudent("Student " + to_string(i), "Faculty " + to_string(i % 12), 1);
+    row("Library with " + to_string(n) + " students: heap growth", ((double)heapInUse() - (double)before) / (1 << 20), "MiB");
+    row("user table bytes()", (double)lib.getUserTable().bytes() / (1 << 20), "MiB");
+    size_t atLimit = 0;
+    vector<uint8_t> eligible;
+    row("bulk eligibility over table", timeIt([&] { for (int r = 0; r < 10; ++r) lib.getUserTable().eligibility(eligible); }) / 10 / n * 1e9, "ns/user");
+    row("findUser by name", timeIt([&] { for (size_t i = 0; i < 100000; ++i) atLimit += lib.findUser("Student " + to_string(i * 7 % n)) == noUser; }) / 100000 * 1e9, "ns");
+    before = heapInUse();
+    vector<unique_ptr<User>> objects;
+    for (size_t i = 0; i < n; ++i) objects.push_back(make_unique<Student>("Student " + to_string(i), "Faculty " + to_string(i % 12), 1));
+    row("same students as heap objects: heap growth", ((double)heapInUse() - (double)before) / (1 << 20), "MiB");
+    row("virtual canBorrow over heap objects", timeIt([&] { for (int r = 0; r < 10; ++r) for (auto& u : objects) atLimit += !u->canBorrow(); }) / 10 / n * 1e9, "ns/user");
+}
+
+// ===== user-125 =====
+void benchReplicas() {
+    for (int followers : {0, 1, 3}) {
+        ReplicatedLibrary rl((size_t)followers, chrono::milliseconds(1), chrono::milliseconds(2));
+        ReadToken admin;
+        for (int id = 1; id <= 2000; ++id) rl.addBook(PrintedBook(id, "B", Author("a"), 2000, "Drama", 1), admin);
+        vector<thread> pool;
+        for (int s = 0; s < 8; ++s)
+            pool.emplace_back([&, s] {
+                ReadToken token;
+                UserRow me = rl.addStudent("s" + to_string(s), "F", 1, token);
+                mt19937 rng((unsigned)s);
+                for (int k = 0; k < 500 * (int)scale; ++k) {
+                    if (k % 10 == 0) rl.checkout(me, 1 + (int)(rng() % 2000), token);
+                    rl.read(token, [&](const Library& lib) { return lib.getUserTable().borrowedBy(me); });
+                }
+            });
+        for (auto& t : pool) t.join();
+        double total = (double)(rl.readsOnFollowers() + rl.readsOnLeader());
+        row(to_string(followers) + " followers: reads served off the leader", 100.0 * rl.readsOnFollowers() / total, "%");
+        row(to_string(followers) + " followers: log entries kept of " + to_string(rl.lastLsn()), (double)rl.logEntries(), "");
+    }
+}
+
+struct Benchmark {
+    const char* name;
+    const char* request;
+    void (*run)();
+};
+
+const Benchmark benchmarks[] = {
+    {"tiering", "user-101", benchTiering},
+    {"asof", "user-102", benchAsOf},
+    {"startup", "user-103", benchStartup},
+    {"sort", "user-104", benchSort},
+    {"audit", "user-105", benchAudit},
+    {"bloom", "user-106", benchBloom},
+    {"genre", "user-107", benchGenre},
+    {"getmany", "user-108", benchGetMany},
+    {"zonemaps", "user-109", benchZoneMaps},
+    {"columns", "user-110", benchColumns},
+    {"sharded", "user-111", benchSharded},
+    {"pipeline", "user-112", benchPipeline},
+    {"metrics", "user-113", benchMetrics},
+    {"searchtype", "user-115", benchSearchType},
+    {"coalescing", "user-116", benchCoalescing},
+    {"eytzinger", "user-117", benchEytzinger},
+    {"cracking", "user-118", benchCracking},
+    {"learned", "user-119", benchLearned},
+    {"simulator", "user-120", benchSimulator},
+    {"fulltext", "user-121", benchFullText},
+    {"transfers", "user-122", benchTransfers},
+    {"scheduler", "user-123", benchScheduler},
+    {"users", "user-124", benchUsers},
+    {"replicas", "user-125", benchReplicas},
+};
+
+}   // namespace
+
+int main(int argc, char** argv) {
+    selfPath = argv[0];
+#ifdef __unix__
+    char exe[4096];
+    ssize_t len = readlink("/proc/self/exe", exe, sizeof exe - 1);
+    if (len > 0) selfPath.assign(exe, (size_t)len);
+#endif
+    if (argc == 4 && string(argv[1]) == "--startup-child") return startupChild(string(argv[2]) == "lazy", (size_t)atoll(argv[3]));
+    vector<string> selected;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg.compare(0, 8, "--scale=") == 0) scale = max(1, atoi(arg.c_str() + 8));
+        else selected.push_back(arg);
+    }
+    for (const Benchmark& b : benchmarks) {
+        if (!selected.empty() && find(selected.begin(), selected.end(), b.name) == selected.end()) continue;
+        cout << "== " << b.name << " (" << b.request << ")\n";
+        b.run();
+    }
+    return 0;
+}
@@ -4,16 +4,204 @@
 #include <memory>
 #include <algorithm>
 #include <iomanip>
+#include <fstream>
+#include <cstdint>
+#include <ctime>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <climits>
+#include <functional>
+#include <sstream>
+#if defined(__unix__) || defined(__APPLE__)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#if defined(__linux__) && defined(__GLIBC__)
+#define LIBRARY_PROFILER 1
+#include <cerrno>
+#include <csignal>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#endif
+#include <map>
+#include <list>
+#include <future>
+#include <cmath>
+#include <queue>
+#include <random>
+#include <iterator>
+#include <shared_mutex>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
 using namespace std;
 
+#if defined(__GNUC__)
+#define PREFETCH(p) __builtin_prefetch(p)
+static inline int lowestBit(uint64_t v) { return __builtin_ctzll(v); }
+#else
+#define PREFETCH(p) ((void)0)
+static inline int lowestBit(uint64_t v) { int i = 0; while (!(v >> i & 1)) ++i; return i; }
+#endif
+
+// ===== Бінарний формат записів холодного сегмента =====
+static void putInt(ostream& os, int32_t v) { os.write(reinterpret_cast<const char*>(&v), sizeof v); }
+static void putDouble(ostream& os, double v) { os.write(reinterpret_cast<const char*>(&v), sizeof v); }
+static void putStr(ostream& os, const string& v) { putInt(os, (int32_t)v.size()); os.write(v.data(), v.size()); }
+static int32_t getInt(istream& is) { int32_t v = 0; is.read(reinterpret_cast<char*>(&v), sizeof v); return v; }
+static double getDouble(istream& is) { double v = 0; is.read(reinterpret_cast<char*>(&v), sizeof v); return v; }
+static string getStr(istream& is) { string v(getInt(is), '\0'); is.read(&v[0], v.size()); return v; }
+
+// ===== Версійоване значення: кожна зміна — контрольна точка з часом =====
+template<typename T>
+class Versioned {
+    vector<pair<time_t, T>> history;   // відсортовано за часом
+    T initial;
+public:
+    explicit Versioned(T init = T()) : initial(move(init)) {}
+    void set(time_t t, T v) {
+        if (history.empty() || history.back().first <= t) { history.emplace_back(t, move(v)); return; }
+        auto it = upper_bound(history.begin(), history.end(), t,
+                              [](time_t x, const pair<time_t, T>& e) { return x < e.first; });
+        history.insert(it, make_pair(t, move(v)));
+    }
+    // Значення на момент t за O(log n)
+    const T& at(time_t t) const {
+        auto it = upper_bound(history.begin(), history.end(), t,
+                              [](time_t x, const pair<time_t, T>& e) { return x < e.first; });
+        return it == history.begin() ? initial : prev(it)->second;
+    }
+    const T& current() const { return history.empty() ? initial : history.back().second; }
+    size_t versions() const { return history.size(); }
+};
+
+// ===== Таксономія жанрів: таблиця часу компіляції з ідеальним хешуванням =====
+// Код 0 — "Other", 1..80 — фіксовані жанри, далі — розширення, зареєстровані під час роботи
+using GenreCode = uint8_t;
+
+constexpr const char* fixedGenres[] = {
+    "Action", "Adventure", "Alternate History", "Anthology", "Art", "Autobiography", "Biography",
+    "Business", "Chick Lit", "Children", "Classics", "Comics", "Coming of Age", "Cookbook",
+    "Crime", "Cyberpunk", "Dark Fantasy", "Detective", "Drama", "Dystopian", "Economics",
+    "Education", "Epic", "Erotica", "Essay", "Fable", "Fairy Tale", "Fantasy", "Folklore",
+    "Gothic", "Graphic Novel", "Health", "Historical Fiction", "History", "Horror", "Humor", "Law",
+    "Legend", "Literary Fiction", "Magical Realism", "Mathematics", "Medicine", "Memoir",
+    "Military", "Music", "Mystery", "Mythology", "Nature", "Noir", "Paranormal", "Parenting",
+    "Philosophy", "Photography", "Poetry", "Politics", "Psychology", "Reference", "Religion",
+    "Romance", "Satire", "Science", "Science Fiction", "Self-Help", "Short Stories", "Space Opera",
+    "Sports", "Spy", "Steampunk", "Suspense", "Technology", "Thriller", "Travel", "True Crime",
+    "Urban Fantasy", "War", "Western", "Young Adult", "Linguistics", "Programming", "Textbook"
+};
+constexpr size_t fixedGenreCount = sizeof(fixedGenres) / sizeof(fixedGenres[0]);
+constexpr size_t genreSlots = 512;
+constexpr uint32_t genreHashSeed = 1341;   // підібрано так, щоб фіксовані жанри не мали колізій
+
+constexpr char lowerAscii(char c) { return c >= 'A' && c <= 'Z' ? char(c - 'A' + 'a') : c; }
+constexpr size_t cstrLen(const char* s) { size_t n = 0; while (s[n]) ++n; return n; }
+
+// FNV-1a без урахування регістру з фінальним перемішуванням murmur3
+constexpr uint32_t genreHash(const char* s, size_t n) {
+    uint32_t x = 2166136261u ^ genreHashSeed;
+    for (size_t i = 0; i < n; ++i) { x ^= (unsigned char)lowerAscii(s[i]); x *= 16777619u; }
+    x ^= x >> 16; x *= 0x85ebca6bu; x ^= x >> 13; x *= 0xc2b2ae35u; x ^= x >> 16;
+    return x;
+}
+
+struct GenreSlotTable {
+    GenreCode slot[genreSlots];
+    bool perfect;
+};
+
+constexpr GenreSlotTable buildGenreSlots() {
+    GenreSlotTable t{};
+    t.perfect = true;
+    for (size_t g = 0; g < fixedGenreCount; ++g) {
+        size_t h = genreHash(fixedGenres[g], cstrLen(fixedGenres[g])) % genreSlots;
+        if (t.slot[h]) t.perfect = false;
+        t.slot[h] = GenreCode(g + 1);
+    }
+    return t;
+}
+
+constexpr GenreSlotTable genreSlotTable = buildGenreSlots();
+static_assert(genreSlotTable.perfect, "genreHashSeed produces collisions for the fixed genre table");
+static_assert(fixedGenreCount < 128, "fixed genres must leave room for runtime extensions");
+
+// Жанри поза фіксованою таблицею; коли коди вичерпано, повертається 0 ("Other")
+class GenreExtensions {
+    mutex mtx;
+    deque<string> names;
+    unordered_map<string, GenreCode> codes;
+public:
+    static GenreExtensions& instance() { static GenreExtensions e; return e; }
+    GenreCode intern(const string& name) {
+        string key(name);
+        for (char& c : key) c = lowerAscii(c);
+        lock_guard<mutex> lock(mtx);
+        auto it = codes.find(key);
+        if (it != codes.end()) return it->second;
+        if (fixedGenreCount + 1 + names.size() > 255) return 0;
+        names.push_back(name);
+        GenreCode c = GenreCode(fixedGenreCount + names.size());
+        codes.emplace(move(key), c);
+        return c;
+    }
+    const string& name(GenreCode c) {
+        lock_guard<mutex> lock(mtx);
+        return names[c - fixedGenreCount - 1];
+    }
+};
+
+static GenreCode genreCode(const string& name) {
+    if (name.empty()) return 0;
+    GenreCode c = genreSlotTable.slot[genreHash(name.data(), name.size()) % genreSlots];
+    if (c) {
+        const char* fixed = fixedGenres[c - 1];
+        size_t i = 0;
+        while (i < name.size() && fixed[i] && lowerAscii(fixed[i]) == lowerAscii(name[i])) ++i;
+        if (i == name.size() && !fixed[i]) return c;
+    }
+    return GenreExtensions::instance().intern(name);
+}
+
+static const string& genreName(GenreCode c) {
+    static const vector<string> fixed = [] {
+        vector<string> v{"Other"};
+        for (const char* g : fixedGenres) v.push_back(g);
+        return v;
+    }();
+    return c <= fixedGenreCount ? fixed[c] : GenreExtensions::instance().name(c);
+}
+
 class Author {
     string name;
 public:
     explicit Author(string n) : name(move(n)) {}
     string getName() const { return name; }
+    size_t heapBytes() const { return name.capacity() > string().capacity() ? name.capacity() + 1 : 0; }
 };
 
+enum class BookType : uint8_t { Printed, EBook, Audio };
+
 class Book {
 protected:
     int id;
@@ -21,23 +209,45 @@ protected:
     Author author;
     int year;
     bool available;
-    string genre;
+    GenreCode genre;
+    bool detached = false;      // копія, яку каталог виніс на диск; зміни через неї відхиляються
+    friend class Catalog;
 public:
     Book(int i, string t, Author a, int y, string g)
-        : id(i), title(move(t)), author(move(a)), year(y), available(true), genre(move(g)) {}
+        : id(i), title(move(t)), author(move(a)), year(y), available(true), genre(genreCode(g)) {}
     virtual ~Book() = default;
 
     virtual void printInfo() const = 0;       // динамічний поліморфізм
     virtual unique_ptr<Book> clone() const = 0;
+    virtual BookType type() const = 0;
+    virtual void serialize(ostream& os) const = 0;
+    static unique_ptr<Book> deserialize(istream& is);
+    virtual size_t bytes() const = 0;         // об'єкт разом із рядками поза SSO
 
-    bool borrow() { if (!available) return false; available = false; return true; }
-    void returnBook() { available = true; }
+    bool borrow() { if (!available || detached) return false; available = false; return true; }
+    void returnBook() { if (!detached) available = true; }
+    bool isDetached() const { return detached; }
+    int getId() const { return id; }
     string getTitle() const { return title; }
+    const Author& getAuthor() const { return author; }
+    int getYear() const { return year; }
+    const string& getGenre() const { return genreName(genre); }
+    GenreCode getGenreCode() const { return genre; }
+    bool isAvailable() const { return available; }
+protected:
+    size_t textBytes() const {
+        return (title.capacity() > string().capacity() ? title.capacity() + 1 : 0) + author.heapBytes();
+    }
+    void serializeBase(ostream& os, char tag) const {
+        os.put(tag); putInt(os, id); putStr(os, title); putStr(os, author.getName());
+        putInt(os, year); os.put(available ? 1 : 0); putStr(os, getGenre());
+    }
 };
 
-class PrintedBook : public Book {
+class PrintedBook final : public Book {
     int pages;
 public:
+    static const BookType kind = BookType::Printed;
     PrintedBook(int i, string t, Author a, int y, string g, int p)
         : Book(i, move(t), move(a), y, move(g)), pages(p) {}
     void printInfo() const override {
@@ -45,11 +255,16 @@ public:
              << ", " << pages << " pages, " << (available ? "available" : "borrowed") << "\n";
     }
     unique_ptr<Book> clone() const override { return make_unique<PrintedBook>(*this); }
+    BookType type() const override { return kind; }
+    int getPages() const { return pages; }
+    void serialize(ostream& os) const override { serializeBase(os, 'P'); putInt(os, pages); }
+    size_t bytes() const override { return sizeof(*this) + textBytes(); }
 };
 
-class EBook : public Book {
+class EBook final : public Book {
     double sizeMB;
 public:
+    static const BookType kind = BookType::EBook;
     EBook(int i, string t, Author a, int y, string g, double s)
         : Book(i, move(t), move(a), y, move(g)), sizeMB(s) {}
     void printInfo() const override {
@@ -57,11 +272,16 @@ public:
              << ", " << fixed << setprecision(1) << sizeMB << " MB, " << (available ? "available" : "borrowed") << "\n";
     }
     unique_ptr<Book> clone() const override { return make_unique<EBook>(*this); }
+    BookType type() const override { return kind; }
+    double getSizeMB() const { return sizeMB; }
+    void serialize(ostream& os) const override { serializeBase(os, 'E'); putDouble(os, sizeMB); }
+    size_t bytes() const override { return sizeof(*this) + textBytes(); }
 };
 
-class AudioBook : public Book {
+class AudioBook final : public Book {
     double duration;
 public:
+    static const BookType kind = BookType::Audio;
     AudioBook(int i, string t, Author a, int y, string g, double d)
         : Book(i, move(t), move(a), y, move(g)), duration(d) {}
     void printInfo() const override {
@@ -69,135 +289,3789 @@ public:
              << ", " << fixed << setprecision(1) << duration << " hours, " << (available ? "available" : "borrowed") << "\n";
     }
     unique_ptr<Book> clone() const override { return make_unique<AudioBook>(*this); }
+    BookType type() const override { return kind; }
+    double getDuration() const { return duration; }
+    void serialize(ostream& os) const override { serializeBase(os, 'A'); putDouble(os, duration); }
+    size_t bytes() const override { return sizeof(*this) + textBytes(); }
 };
 
-class Catalog {
-    vector<unique_ptr<Book>> books;
+unique_ptr<Book> Book::deserialize(istream& is) {
+    char tag = (char)is.get();
+    int i = getInt(is);
+    string t = getStr(is), a = getStr(is);
+    int y = getInt(is);
+    bool avail = is.get() != 0;
+    string g = getStr(is);
+    unique_ptr<Book> b;
+    if (tag == 'P') b = make_unique<PrintedBook>(i, t, Author(a), y, g, getInt(is));
+    else if (tag == 'E') b = make_unique<EBook>(i, t, Author(a), y, g, getDouble(is));
+    else b = make_unique<AudioBook>(i, t, Author(a), y, g, getDouble(is));
+    b->available = avail;
+    return b;
+}
+
+// ===== Метрики: лічильники й гістограми у сховищі кожного потоку =====
+// Кожен потік пише лише у свій шард без атомарних RMW; збирач лише читає всі шарди
+enum class Operation : uint8_t { Search, AddBook, Borrow, Return, RegisterUser, TransferPlan, Count };
+enum class MetricCounter : uint8_t {
+    ResidentHit, ColdFault, IndexHit, IndexFallback, QueryCacheHit, QueryCoalesced, QueryExecuted, Count
+};
+
+class Metrics {
 public:
-    void addBook(const Book& b) { books.push_back(b.clone()); }
-    void listAll() const { for (const auto& b : books) b->printInfo(); }
+    static const int bucketCount = 12;
+    static constexpr double bucketBounds[bucketCount - 1] = {1e-6, 5e-6, 1e-5, 5e-5, 1e-4, 5e-4, 1e-3, 5e-3, 1e-2, 5e-2, 1e-1};
+private:
+    struct Shard {
+        atomic<uint64_t> buckets[(int)Operation::Count][bucketCount];
+        atomic<uint64_t> sumNs[(int)Operation::Count];
+        atomic<uint64_t> counters[(int)MetricCounter::Count];
+        Shard() {
+            for (auto& op : buckets) for (auto& b : op) b.store(0, memory_order_relaxed);
+            for (auto& v : sumNs) v.store(0, memory_order_relaxed);
+            for (auto& v : counters) v.store(0, memory_order_relaxed);
+        }
+    };
+    struct Gauge {
+        uint64_t group;
+        string name, help, labels;
+        function<double()> read;
+    };
+    // registryMutex тримається лише на додавання шарда чи копіювання списку, тож новий потік
+    // не чекає на збір; gaugeMutex тримається, поки збір читає показники, щоб зняття групи
+    // дочекалося читань, які ще звертаються до її об'єкта
+    mutex registryMutex, gaugeMutex;
+    vector<unique_ptr<Shard>> shards;   // шарди завершених потоків лишаються: лічильники монотонні
+    vector<Gauge> gauges;
+    uint64_t nextGroup = 0;
 
-    // ===== Статичний поліморфізм через шаблонну функцію =====
-    template<typename Pred>
-    vector<Book*> search(Pred p) {
-        vector<Book*> result;
-        for (auto& b : books)
-            if (p(*b)) result.push_back(b.get());
-        return result;
+    vector<Shard*> shardList() {
+        lock_guard<mutex> lock(registryMutex);
+        vector<Shard*> list;
+        for (auto& sh : shards) list.push_back(sh.get());
+        return list;
     }
-};
 
-class User {
-protected:
-    string name;
-    int borrowed;
+    static void bump(atomic<uint64_t>& v, uint64_t by) { v.store(v.load(memory_order_relaxed) + by, memory_order_relaxed); }
+    Shard& local() {
+        thread_local Shard* shard = nullptr;
+        if (!shard) {
+            lock_guard<mutex> lock(registryMutex);
+            shards.push_back(make_unique<Shard>());
+            shard = shards.back().get();
+        }
+        return *shard;
+    }
 public:
-    User(string n) : name(move(n)), borrowed(0) {}
-    virtual void showRole() const = 0;        // динамічний поліморфізм
-    virtual bool canBorrow() const = 0;
-    void borrowBook() { borrowed++; }
-    void returnBook() { if (borrowed>0) borrowed--; }
-    string getName() const { return name; }
+    static Metrics& instance() { static Metrics m; return m; }
+
+    void observe(Operation op, chrono::nanoseconds elapsed) {
+        Shard& s = local();
+        double sec = elapsed.count() * 1e-9;
+        int b = 0;
+        while (b < bucketCount - 1 && sec > bucketBounds[b]) ++b;
+        bump(s.buckets[(int)op][b], 1);
+        bump(s.sumNs[(int)op], elapsed.count());
+    }
+    void count(MetricCounter c, uint64_t by = 1) { bump(local().counters[(int)c], by); }
+
+    // Сумарні кількість і час операції по всіх потоках
+    pair<uint64_t, uint64_t> totals(Operation op) {
+        uint64_t n = 0, ns = 0;
+        for (Shard* sh : shardList()) {
+            for (auto& b : sh->buckets[(int)op]) n += b.load(memory_order_relaxed);
+            ns += sh->sumNs[(int)op].load(memory_order_relaxed);
+        }
+        return {n, ns};
+    }
+
+    // Група показників одного об'єкта; знімається разом через removeGauges
+    uint64_t newGaugeGroup() { lock_guard<mutex> lock(gaugeMutex); return ++nextGroup; }
+
+    // Показник, що зчитується під час збору; функція не повинна блокувати
+    void addGauge(uint64_t group, string name, string help, string labels, function<double()> read) {
+        lock_guard<mutex> lock(gaugeMutex);
+        gauges.push_back(Gauge{group, move(name), move(help), move(labels), move(read)});
+    }
+
+    // Після повернення жоден збір уже не читає показники групи
+    void removeGauges(uint64_t group) {
+        lock_guard<mutex> lock(gaugeMutex);
+        gauges.erase(remove_if(gauges.begin(), gauges.end(), [group](const Gauge& g) { return g.group == group; }), gauges.end());
+    }
+
+    // Текстовий формат Prometheus 0.0.4
+    string render() {
+        static const char* opNames[] = {"search", "add_book", "borrow", "return", "register_user", "transfer_plan"};
+        static const char* counterNames[] = {"library_residency_hits_total", "library_residency_faults_total",
+                                             "library_index_hits_total", "library_index_fallbacks_total",
+                                             "library_query_cache_hits_total", "library_query_coalesced_total",
+                                             "library_query_executions_total"};
+        uint64_t buckets[(int)Operation::Count][bucketCount] = {}, sums[(int)Operation::Count] = {}, counters[(int)MetricCounter::Count] = {};
+        for (Shard* sh : shardList()) {
+            for (int o = 0; o < (int)Operation::Count; ++o) {
+                for (int b = 0; b < bucketCount; ++b) buckets[o][b] += sh->buckets[o][b].load(memory_order_relaxed);
+                sums[o] += sh->sumNs[o].load(memory_order_relaxed);
+            }
+            for (int c = 0; c < (int)MetricCounter::Count; ++c) counters[c] += sh->counters[c].load(memory_order_relaxed);
+        }
+        ostringstream out;
+        out << "# HELP library_operation_seconds Latency of library operations.\n"
+            << "# TYPE library_operation_seconds histogram\n";
+        for (int o = 0; o < (int)Operation::Count; ++o) {
+            uint64_t cumulative = 0;
+            for (int b = 0; b < bucketCount; ++b) {
+                cumulative += buckets[o][b];
+                out << "library_operation_seconds_bucket{op=\"" << opNames[o] << "\",le=\"";
+                if (b < bucketCount - 1) out << bucketBounds[b]; else out << "+Inf";
+                out << "\"} " << cumulative << "\n";
+            }
+            out << "library_operation_seconds_sum{op=\"" << opNames[o] << "\"} " << sums[o] * 1e-9 << "\n"
+                << "library_operation_seconds_count{op=\"" << opNames[o] << "\"} " << cumulative << "\n";
+        }
+        for (int c = 0; c < (int)MetricCounter::Count; ++c)
+            out << "# TYPE " << counterNames[c] << " counter\n" << counterNames[c] << " " << counters[c] << "\n";
+        // Показники з однаковою назвою (наприклад, від кількох каталогів) ідуть одним блоком
+        lock_guard<mutex> lock(gaugeMutex);
+        vector<const Gauge*> ordered;
+        for (const Gauge& g : gauges) ordered.push_back(&g);
+        stable_sort(ordered.begin(), ordered.end(), [](const Gauge* a, const Gauge* b) { return a->name < b->name; });
+        string last;
+        for (const Gauge* g : ordered) {
+            if (g->name != last) out << "# HELP " << g->name << " " << g->help << "\n# TYPE " << g->name << " gauge\n";
+            last = g->name;
+            out << g->name << (g->labels.empty() ? "" : "{" + g->labels + "}") << " " << g->read() << "\n";
+        }
+        return out.str();
+    }
 };
+constexpr double Metrics::bucketBounds[];
 
-class Student : public User {
-    string faculty;
-    int yearStudy;
+// Знімає свою групу показників при знищенні; переміщується, але не копіюється
+class GaugeRegistration {
+    uint64_t group = 0;
 public:
-    Student(string n, string f, int y) : User(move(n)), faculty(move(f)), yearStudy(y) {}
-    void showRole() const override {
-        cout << name << " - Student, " << faculty << ", year " << yearStudy << "\n";
+    GaugeRegistration() = default;
+    explicit GaugeRegistration(uint64_t g) : group(g) {}
+    GaugeRegistration(GaugeRegistration&& o) noexcept : group(o.group) { o.group = 0; }
+    GaugeRegistration& operator=(GaugeRegistration&& o) noexcept {
+        if (this != &o) { reset(); group = o.group; o.group = 0; }
+        return *this;
+    }
+    GaugeRegistration(const GaugeRegistration&) = delete;
+    GaugeRegistration& operator=(const GaugeRegistration&) = delete;
+    ~GaugeRegistration() { reset(); }
+    uint64_t id() const { return group; }
+    void reset() {
+        if (group) Metrics::instance().removeGauges(group);
+        group = 0;
     }
-    bool canBorrow() const override { return borrowed < 5; }
 };
 
-class Librarian : public User {
-    string employeeId;
+// Вимірює час операції до кінця області видимості
+class ScopedTimer {
+    Operation op;
+    chrono::steady_clock::time_point start;
 public:
-    Librarian(string n, string id) : User(move(n)), employeeId(move(id)) {}
-    void showRole() const override {
-        cout << name << " - Librarian, ID: " << employeeId << "\n";
+    explicit ScopedTimer(Operation o) : op(o), start(chrono::steady_clock::now()) {}
+    ~ScopedTimer() { Metrics::instance().observe(op, chrono::steady_clock::now() - start); }
+};
+
+// ===== Статичний індекс у розкладці Ейтцінгера =====
+// Ключі лежать у порядку обходу в ширину, тож спуск іде по суміжних кеш-лініях і
+// передвибірка нащадків на кілька рівнів уперед прихована за порівняннями
+template<typename Key>
+class EytzingerIndex {
+    vector<Key> sorted;             // ключі за зростанням
+    vector<uint32_t> payload;       // позиція запису для кожного ключа з sorted
+    vector<Key> tree;               // tree[1..n]
+    vector<uint32_t> rank;          // номер вузла tree[k] у sorted
+
+    size_t fill(size_t k, size_t i) {
+        if (k >= tree.size()) return i;
+        i = fill(2 * k, i);
+        tree[k] = sorted[i];
+        rank[k] = (uint32_t)i++;
+        return fill(2 * k + 1, i);
     }
-    bool canBorrow() const override { return true; }
+public:
+    EytzingerIndex() = default;
+    explicit EytzingerIndex(vector<pair<Key, uint32_t>> entries) {
+        sort(entries.begin(), entries.end());
+        for (auto& e : entries) { sorted.push_back(move(e.first)); payload.push_back(e.second); }
+        tree.resize(sorted.size() + 1);
+        rank.resize(sorted.size() + 1);
+        fill(1, 0);
+    }
+
+    // Номер першого ключа >= x у порядку сортування (size(), якщо такого немає)
+    size_t lowerBound(const Key& x) const {
+        const size_t n = sorted.size(), ahead = 64 / sizeof(Key) > 1 ? 64 / sizeof(Key) : 2;
+        size_t k = 1;
+        while (k <= n) {
+            if (k * ahead <= n) PREFETCH(&tree[k * ahead]);
+            k = 2 * k + (tree[k] < x);
+        }
+        while (k & 1) k >>= 1;      // зняти хвіст правих кроків: вузол, де був останній лівий
+        k >>= 1;
+        return k == 0 ? n : rank[k];
+    }
+    const Key& keyAt(size_t r) const { return sorted[r]; }
+    uint32_t payloadAt(size_t r) const { return payload[r]; }
+    size_t size() const { return sorted.size(); }
 };
 
-class Library {
-    Catalog catalog;
-    vector<unique_ptr<User>> users;
-    int nextBookId = 1;
+// ===== Адаптивне індексування (database cracking) =====
+// Копія стовпця (значення, позиція) поступово переупорядковується самими запитами:
+// кожна межа діапазону розбиває лише той шматок, у який потрапила
+class CrackerColumn {
+    vector<pair<double, uint32_t>> data;
+    map<double, size_t> cracks;     // межа v → перший індекс у data зі значенням >= v
+    vector<pair<double, uint32_t>> pending;   // додані після побудови, ще не злиті
+
+    size_t crack(double pivot) {
+        auto it = cracks.lower_bound(pivot);
+        if (it != cracks.end() && it->first == pivot) return it->second;
+        size_t end = it == cracks.end() ? data.size() : it->second;
+        size_t begin = it == cracks.begin() ? 0 : prev(it)->second;
+        auto mid = partition(data.begin() + begin, data.begin() + end,
+                             [pivot](const pair<double, uint32_t>& e) { return e.first < pivot; });
+        size_t pos = mid - data.begin();
+        cracks.emplace_hint(it, pivot, pos);
+        return pos;
+    }
 public:
-    Catalog& getCatalog() { return catalog; }
+    explicit CrackerColumn(vector<pair<double, uint32_t>> values) : data(move(values)) {}
 
-    int newBookId() { return nextBookId++; }
+    void append(double v, uint32_t row) {
+        pending.emplace_back(v, row);
+        if (pending.size() * 16 > data.size() + 16) {   // хвіст надто великий — нова копія без тріщин
+            data.insert(data.end(), pending.begin(), pending.end());
+            pending.clear();
+            cracks.clear();
+        }
+    }
+
+    // Позиції записів зі значенням у [lo, hi]
+    vector<uint32_t> range(double lo, double hi) {
+        vector<uint32_t> rows;
+        if (lo > hi) return rows;
+        size_t from = crack(lo), to = crack(nextafter(hi, INFINITY));
+        for (size_t i = from; i < to; ++i) rows.push_back(data[i].second);
+        for (const auto& e : pending)
+            if (e.first >= lo && e.first <= hi) rows.push_back(e.second);
+        return rows;
+    }
+    size_t pieces() const { return cracks.size() + 1; }
+};
+
+// ===== Навчений індекс: кусково-лінійна модель позиції з обмеженою похибкою =====
+// Модель будується над різними ключами (позиція — перше входження), тож повтори років
+// не збільшують кількість сегментів. Нові ключі йдуть у відсортований буфер вставок
+class LearnedIndex {
+    struct Segment {
+        int64_t first;
+        double slope;
+        size_t start;
+    };
+    vector<int64_t> keys;
+    vector<uint32_t> payload;
+    vector<Segment> segments;
+    vector<pair<int64_t, uint32_t>> buffer;
+    size_t epsilon;
 
-    Student* addStudent(string n, string f, int y) {
-        auto u = make_unique<Student>(move(n), move(f), y);
-        Student* ptr = u.get();
-        users.push_back(move(u));
-        return ptr;
+    // Жадібний "звужуваний конус": сегмент продовжується, поки існує нахил,
+    // що тримає всі точки в межах ±epsilon
+    void train() {
+        segments.clear();
+        size_t i = 0, n = keys.size();
+        while (i < n) {
+            Segment seg{keys[i], 0.0, i};
+            double lo = 0, hi = INFINITY;
+            size_t j = i;
+            while (j < n && keys[j] == seg.first) ++j;
+            while (j < n) {
+                double dx = (double)(keys[j] - seg.first), dy = (double)(j - i);
+                double nlo = max(lo, (dy - epsilon) / dx), nhi = min(hi, (dy + epsilon) / dx);
+                if (nlo > nhi) break;
+                lo = nlo;
+                hi = nhi;
+                int64_t k = keys[j];
+                while (j < n && keys[j] == k) ++j;
+            }
+            seg.slope = isinf(hi) ? 0.0 : (lo + hi) / 2;
+            segments.push_back(seg);
+            i = j;
+        }
     }
 
-    Librarian* addLibrarian(string n, string id) {
-        auto u = make_unique<Librarian>(move(n), move(id));
-        Librarian* ptr = u.get();
-        users.push_back(move(u));
-        return ptr;
+    // Перший індекс у keys з ключем >= x; вікно ±epsilon розширюється, якщо x поза множиною
+    size_t lowerBound(int64_t x) const {
+        size_t n = keys.size();
+        if (segments.empty()) return n;
+        auto it = upper_bound(segments.begin(), segments.end(), x,
+                              [](int64_t v, const Segment& s) { return v < s.first; });
+        if (it == segments.begin()) return 0;
+        const Segment& seg = *prev(it);
+        double predicted = seg.start + seg.slope * (double)(x - seg.first);
+        size_t p = (size_t)max(0.0, min((double)n, predicted));
+        size_t lo = p > epsilon ? p - epsilon : 0, hi = min(n, p + epsilon + 1);
+        for (size_t step = epsilon + 1; lo > 0 && keys[lo - 1] >= x; step *= 2) lo = lo > step ? lo - step : 0;
+        for (size_t step = epsilon + 1; hi < n && keys[hi - 1] < x; step *= 2) hi = min(n, hi + step);
+        return lower_bound(keys.begin() + lo, keys.begin() + hi, x) - keys.begin();
+    }
+public:
+    explicit LearnedIndex(vector<pair<int64_t, uint32_t>> entries = {}, size_t eps = 32) : epsilon(max<size_t>(1, eps)) {
+        sort(entries.begin(), entries.end());
+        for (auto& e : entries) { keys.push_back(e.first); payload.push_back(e.second); }
+        train();
     }
 
-    void listUsers() const {
-        for (auto& u : users) u->showRole();
+    void insert(int64_t key, uint32_t value) {
+        auto e = make_pair(key, value);
+        buffer.insert(upper_bound(buffer.begin(), buffer.end(), e), e);
+        if (buffer.size() * buffer.size() > keys.size() + 1024) {   // буфер ~ sqrt(n): злиття й перенавчання
+            vector<pair<int64_t, uint32_t>> all;
+            all.reserve(keys.size() + buffer.size());
+            for (size_t i = 0; i < keys.size(); ++i) all.emplace_back(keys[i], payload[i]);
+            all.insert(all.end(), buffer.begin(), buffer.end());
+            *this = LearnedIndex(move(all), epsilon);
+        }
+    }
+
+    // Значення для ключів у [lo, hi]
+    vector<uint32_t> range(int64_t lo, int64_t hi) const {
+        vector<uint32_t> out;
+        for (size_t i = lowerBound(lo); i < keys.size() && keys[i] <= hi; ++i) out.push_back(payload[i]);
+        for (auto it = lower_bound(buffer.begin(), buffer.end(), make_pair(lo, (uint32_t)0));
+             it != buffer.end() && it->first <= hi; ++it) out.push_back(it->second);
+        return out;
+    }
+    bool find(int64_t key, uint32_t& value) const {
+        size_t i = lowerBound(key);
+        if (i < keys.size() && keys[i] == key) { value = payload[i]; return true; }
+        auto it = lower_bound(buffer.begin(), buffer.end(), make_pair(key, (uint32_t)0));
+        if (it != buffer.end() && it->first == key) { value = it->second; return true; }
+        return false;
     }
+
+    // Пам'ять саме моделі (без масиву ключів, який є у будь-якого впорядкованого індексу)
+    size_t modelBytes() const { return segments.size() * sizeof(Segment); }
+    size_t segmentCount() const { return segments.size(); }
 };
 
-void printMenu() {
-    cout << "\n=== Menu ===\n";
-    cout << "1. Add book\n2. List catalog\n3. Add student\n4. Add librarian\n5. List users\n0. Exit\n";
+enum class NumericField { Year, Pages, SizeMB, Duration };
+
+// Поля, за якими Catalog будує індекси
+enum class IndexField { Title, Author, Genre };
+enum class SortOrder { None, Title, Author };
+
+// Умови сканування, які перевіряються спершу на зонних картах блоків
+struct ScanFilter {
+    int yearMin = INT_MIN, yearMax = INT_MAX;
+    uint8_t typeMask = 0x7;         // біт 1 << BookType
+    int genre = -1;                 // GenreCode або -1 — будь-який
+};
+
+// ===== Ключі впорядкування та паралельне MSD-сортування =====
+// Нормалізований ключ: нижній регістр, лише літери/цифри, пробіли стиснуті
+static string collationKey(const string& s) {
+    string k;
+    k.reserve(s.size());
+    for (unsigned char c : s) {
+        if (isalnum(c) || c >= 0x80) k += (char)tolower(c);
+        else if (isspace(c) && !k.empty() && k.back() != ' ') k += ' ';
+    }
+    if (!k.empty() && k.back() == ' ') k.pop_back();
+    return k;
 }
 
-int main() {
-    Library lib;
+static inline int byteAt(const string& k, size_t d) { return d < k.size() ? (unsigned char)k[d] + 1 : 0; }
 
-    lib.getCatalog().addBook(PrintedBook(lib.newBookId(),"Book1",Author("Author1"),2020,"History",200));
-    lib.getCatalog().addBook(EBook(lib.newBookId(),"Book2",Author("Author2"),2021,"Poetry",2.5));
-    lib.getCatalog().addBook(AudioBook(lib.newBookId(),"Book3",Author("Author3"),2019,"Drama",3.0));
+// Стабільне MSD-сортування індексів a[0..n) за keys; tmp — буфер того ж розміру
+static void msdRadixSort(const vector<string>& keys, size_t* a, size_t* tmp, size_t n, size_t depth) {
+    if (n < 32) {
+        for (size_t i = 1; i < n; ++i) {
+            size_t v = a[i], j = i;
+            while (j > 0 && keys[a[j - 1]].compare(min(depth, keys[a[j - 1]].size()), string::npos,
+                                                   keys[v], min(depth, keys[v].size()), string::npos) > 0) {
+                a[j] = a[j - 1]; --j;
+            }
+            a[j] = v;
+        }
+        return;
+    }
+    size_t start[258] = {};
+    for (size_t i = 0; i < n; ++i) start[byteAt(keys[a[i]], depth) + 1]++;
+    for (int b = 1; b < 258; ++b) start[b] += start[b - 1];
+    size_t pos[257];
+    copy(start, start + 257, pos);
+    for (size_t i = 0; i < n; ++i) tmp[pos[byteAt(keys[a[i]], depth)]++] = a[i];
+    copy(tmp, tmp + n, a);
+    for (int b = 1; b < 257; ++b)   // кошик 0 — ключі, що вже закінчились, вони рівні
+        if (start[b + 1] - start[b] > 1)
+            msdRadixSort(keys, a + start[b], tmp + start[b], start[b + 1] - start[b], depth + 1);
+}
 
-    int choice;
-    while (true) {
-        printMenu();
-        cout << "Choice: ";
-        if (!(cin >> choice)) { cin.clear(); cin.ignore(1000,'\n'); continue; }
-        cin.ignore();
-        if (choice==0) break;
+// Перший розподіл — послідовно, далі кошики першого байта розбирають робочі потоки
+static vector<size_t> parallelRadixSort(const vector<string>& keys) {
+    size_t n = keys.size();
+    vector<size_t> a(n), tmp(n);
+    for (size_t i = 0; i < n; ++i) a[i] = i;
+    size_t start[258] = {};
+    for (size_t i = 0; i < n; ++i) start[byteAt(keys[i], 0) + 1]++;
+    for (int b = 1; b < 258; ++b) start[b] += start[b - 1];
+    size_t pos[257];
+    copy(start, start + 257, pos);
+    for (size_t i = 0; i < n; ++i) tmp[pos[byteAt(keys[i], 0)]++] = i;
+    a.swap(tmp);
 
-        if (choice==1) {
-            int type; cout << "Type (1-Printed,2-EBook,3-Audio): "; cin >> type; cin.ignore();
-            string title, author, genre; int year;
-            cout << "Title: "; getline(cin,title);
-            cout << "Author: "; getline(cin,author);
-            cout << "Year: "; cin >> year; cin.ignore();
-            cout << "Genre: "; getline(cin,genre);
-            int id = lib.newBookId();
-            if (type==1) { int pages; cout << "Pages: "; cin >> pages; cin.ignore(); lib.getCatalog().addBook(PrintedBook(id,title,Author(author),year,genre,pages)); }
-            else if (type==2) { double size; cout << "Size MB: "; cin >> size; cin.ignore(); lib.getCatalog().addBook(EBook(id,title,Author(author),year,genre,size)); }
-            else { double dur; cout << "Duration hours: "; cin >> dur; cin.ignore(); lib.getCatalog().addBook(AudioBook(id,title,Author(author),year,genre,dur)); }
+    vector<int> buckets;
+    for (int b = 1; b < 257; ++b) if (start[b + 1] - start[b] > 1) buckets.push_back(b);
+    sort(buckets.begin(), buckets.end(), [&](int x, int y) { return start[x + 1] - start[x] > start[y + 1] - start[y]; });
+    atomic<size_t> next(0);
+    auto work = [&] {
+        for (size_t i; (i = next++) < buckets.size();) {
+            int b = buckets[i];
+            msdRadixSort(keys, &a[start[b]], &tmp[start[b]], start[b + 1] - start[b], 1);
         }
-        else if (choice==2) { lib.getCatalog().listAll(); }
-        else if (choice==3) {
-            string n,f; int y;
-            cout << "Name: "; getline(cin,n);
-            cout << "Faculty: "; getline(cin,f);
-            cout << "Year: "; cin >> y; cin.ignore();
-            lib.addStudent(n,f,y);
+    };
+    size_t workers = n < 100000 ? 1 : max(1u, thread::hardware_concurrency());
+    vector<thread> pool;
+    for (size_t t = 1; t < workers; ++t) pool.emplace_back(work);
+    work();
+    for (auto& t : pool) t.join();
+    return a;
+}
+
+class Catalog {
+    // Гарячий запис тримає book у пам'яті; холодний — лише заглушку зі зсувом у сегменті
+    struct Slot {
+        unique_ptr<Book> book;
+        int id;
+        uint32_t hits;
+        int64_t coldOffset;
+        uint32_t coldBytes;
+    };
+    vector<Slot> books;
+    string segmentPath;
+    mutable fstream segment;
+    uint64_t segmentEnd = 0, liveColdBytes = 0;   // решта сегмента — записи, що вже повернулися в пам'ять
+    // Об'єкти, винесені на диск попереднім проходом tierCold. Видані покажчики на них
+    // відкріплені: читання бачать стан на момент винесення, borrow/returnBook відхиляються.
+    // Пам'ять звільняє наступний прохід tierCold або reclaim()
+    vector<unique_ptr<Book>> retired;
+
+    // Мін/макс по блоках з zoneRows записів: дозволяють пропускати цілі блоки
+    struct Zone {
+        int yearMin = INT_MAX, yearMax = INT_MIN;
+        uint8_t typeMask = 0;
+        GenreCode genreMin = 255, genreMax = 0;
+    };
+    static const size_t zoneRows = 256;
+    vector<Zone> zones;
+    vector<uint32_t> byType[3];     // позиції записів кожного підтипу; після cluster() — суцільні діапазони
+
+    // Заморожений сегмент [0, frozenCount) має статичні впорядковані індекси;
+    // записи, додані після freeze(), переглядаються окремо
+    struct FrozenSegment {
+        size_t count = 0;
+        EytzingerIndex<int> byId, byYear;
+        EytzingerIndex<string> byTitle;
+    } frozen;
+
+    // Навчені індекси за id і роком; якщо увімкнені, findById і learnedYearRange йдуть через них
+    unique_ptr<LearnedIndex> learnedById, learnedByYear;
+
+    void trainLearned() {
+        vector<pair<int64_t, uint32_t>> ids, years;
+        for (size_t i = 0; i < books.size(); ++i)
+            withBook(books[i], [&](const Book& b) {
+                ids.emplace_back(b.getId(), (uint32_t)i);
+                years.emplace_back(b.getYear(), (uint32_t)i);
+            });
+        learnedById = make_unique<LearnedIndex>(move(ids));
+        learnedByYear = make_unique<LearnedIndex>(move(years));
+    }
+
+    // Копії числових стовпців для адаптивного індексування; створюються першим запитом
+    unique_ptr<CrackerColumn> crackers[4];
+
+    // Значення поля для книги; для полів підтипу інші підтипи не мають значення
+    static bool numericValue(const Book& b, NumericField f, double& v) {
+        switch (f) {
+            case NumericField::Year: v = b.getYear(); return true;
+            case NumericField::Pages:
+                if (b.type() != BookType::Printed) return false;
+                v = static_cast<const PrintedBook&>(b).getPages(); return true;
+            case NumericField::SizeMB:
+                if (b.type() != BookType::EBook) return false;
+                v = static_cast<const EBook&>(b).getSizeMB(); return true;
+            default:
+                if (b.type() != BookType::Audio) return false;
+                v = static_cast<const AudioBook&>(b).getDuration(); return true;
         }
-        else if (choice==4) {
-            string n,id;
-            cout << "Name: "; getline(cin,n);
-            cout << "Employee ID: "; getline(cin,id);
-            lib.addLibrarian(n,id);
+    }
+
+    // Об'єднує діапазон статичного індексу з відповідними записами хвоста
+    template<typename Key, typename Below, typename KeyOf>
+    vector<Book*> orderedRange(const EytzingerIndex<Key>& index, const Key& lo, Below belowHi, size_t limit, KeyOf keyOf) {
+        vector<pair<Key, uint32_t>> tail;
+        for (size_t i = frozen.count; i < books.size(); ++i) {
+            Key k = withBook(books[i], keyOf);
+            if (!(k < lo) && belowHi(k)) tail.emplace_back(move(k), (uint32_t)i);
+        }
+        sort(tail.begin(), tail.end());
+        vector<Book*> result;
+        size_t r = index.lowerBound(lo), t = 0;
+        while (result.size() < limit) {
+            bool fromIndex = r < index.size() && belowHi(index.keyAt(r));
+            if (!fromIndex && t == tail.size()) break;
+            if (fromIndex && (t == tail.size() || !(tail[t].first < index.keyAt(r)))) result.push_back(touch(books[index.payloadAt(r++)]));
+            else result.push_back(touch(books[tail[t++].second]));
+        }
+        return result;
+    }
+    uint64_t layoutEpoch = 0;       // змінюється при переупорядкуванні записів
+public:
+    // Лічильники для метрик; читаються без блокування каталогу
+    struct Stats {
+        atomic<size_t> resident{0}, cold{0}, indexEntries{0}, idSlots{0}, indexBytes{0}, indexBuilds{0};
+        // Пам'ять за Book::bytes() (разом із відкріпленими копіями до їх звільнення), масиву записів і таблиці id
+        atomic<size_t> bookBytes{0}, slotBytes{0}, idTableBytes{0};
+    };
+private:
+    Stats counters;
+
+    // Індекс будується при першому використанні або фоновим прогрівом
+    struct LazyIndex {
+        enum State { Absent, Queued, Building, Ready };
+        State state = Absent;
+        bool overBudget = false;    // сам індекс більший за межу: не будується, запити сканують
+        unordered_multimap<string, size_t> map;
+        size_t bytes = 0;
+        uint64_t lastUse = 0;
+    };
+    LazyIndex indexes[3];
+    uint64_t useClock = 0;
+    size_t indexBudget = SIZE_MAX;  // межа пам'яті індексів; при перевищенні найдавніші скидаються
+
+    static size_t entryBytes(const string& key) {
+        return key.capacity() + sizeof(pair<const string, size_t>) + 2 * sizeof(void*);
+    }
+    void dropIndex(LazyIndex& idx) {
+        if (idx.state == LazyIndex::Ready) {
+            counters.indexEntries -= idx.map.size();
+            counters.indexBytes -= idx.bytes;
+        }
+        unordered_multimap<string, size_t>().swap(idx.map);
+        idx.bytes = 0;
+        idx.state = LazyIndex::Absent;
+    }
+    // Викликається під блокуванням; лічильник байтів ведеться інкрементно, тож кожен крок — O(1)
+    void evictLocked(size_t budgetBytes) {
+        while (counters.indexBytes > budgetBytes) {
+            LazyIndex* victim = nullptr;
+            for (auto& idx : indexes)
+                if (idx.state == LazyIndex::Ready && (!victim || idx.lastUse < victim->lastUse)) victim = &idx;
+            if (!victim) return;
+            if (victim->bytes > budgetBytes) victim->overBudget = true;   // інакше перебудова й скидання по колу
+            dropIndex(*victim);
+        }
+    }
+
+    // Відкрита адресація id → позиція; місткість — степінь двійки
+    struct IdSlot {
+        int id;
+        uint32_t pos;
+    };
+    static const uint32_t emptyPos = UINT32_MAX;
+    vector<IdSlot> idTable = vector<IdSlot>(16, IdSlot{0, emptyPos});
+    size_t idCount = 0;
+
+    size_t idHome(int id) const { return (uint32_t)id * 0x9E3779B1u >> 7 & (idTable.size() - 1); }
+    void idInsert(int id, uint32_t pos) {
+        if ((idCount + 1) * 2 > idTable.size()) {
+            vector<IdSlot> old(idTable.size() * 2, IdSlot{0, emptyPos});
+            old.swap(idTable);
+            idCount = 0;
+            for (const IdSlot& e : old) if (e.pos != emptyPos) idInsert(e.id, e.pos);
+        }
+        size_t mask = idTable.size() - 1;
+        for (size_t h = idHome(id);; h = (h + 1) & mask) {
+            if (idTable[h].pos == emptyPos) { idTable[h] = IdSlot{id, pos}; idCount++; return; }
+            if (idTable[h].id == id) return;   // перший запис з таким id лишається основним
+        }
+    }
+    uint32_t idProbe(size_t h, int id) const {
+        size_t mask = idTable.size() - 1;
+        for (;; h = (h + 1) & mask)
+            if (idTable[h].pos == emptyPos || idTable[h].id == id) return idTable[h].pos;
+    }
+    uint32_t positionOf(int id) const {
+        uint32_t pos = emptyPos;
+        if (learnedById) learnedById->find(id, pos);
+        else pos = idProbe(idHome(id), id);
+        return pos;
+    }
+    mutable mutex mtx;
+    // Фонова побудова індексів: черга полів і робочий потік, що живе, поки черга не порожня
+    deque<IndexField> buildQueue;
+    bool builderRunning = false;
+    condition_variable buildIdle;
+    thread builder;
+    // Слухачі додавання книг (напр., повнотекстовий індекс)
+    mutex listenerMutex;
+    map<size_t, function<void(const Book&)>> listeners;
+    size_t nextListener = 0;
+
+    unique_ptr<Book> loadCold(const Slot& s) const {
+        segment.clear();
+        segment.seekg(s.coldOffset);
+        return Book::deserialize(segment);
+    }
+    void promote(Slot& s, unique_ptr<Book> b) {
+        counters.bookBytes += b->bytes();
+        s.book = move(b);
+        s.coldOffset = -1;
+        liveColdBytes -= s.coldBytes;
+        counters.cold--;
+        counters.resident++;
+        Metrics::instance().count(MetricCounter::ColdFault);
+    }
+    Book* touch(Slot& s) {
+        if (!s.book) promote(s, loadCold(s));
+        else Metrics::instance().count(MetricCounter::ResidentHit);
+        s.hits++;
+        return s.book.get();
+    }
+    static string keyOf(const Book& b, IndexField f) {
+        switch (f) {
+            case IndexField::Title: return b.getTitle();
+            case IndexField::Author: return b.getAuthor().getName();
+            default: return b.getGenre();
+        }
+    }
+    // Виклик f для книги запису без повернення холодного запису в пам'ять
+    template<typename F>
+    auto withBook(const Slot& s, F f) const -> decltype(f(declval<const Book&>())) {
+        if (s.book) return f(*s.book);
+        auto tmp = loadCold(s);
+        return f(*tmp);
+    }
+    string keyAt(size_t i, IndexField f) const {
+        return withBook(books[i], [f](const Book& b) { return keyOf(b, f); });
+    }
+    vector<Book*> scanBy(IndexField f, const string& key) {
+        vector<Book*> result;
+        for (size_t i = 0; i < books.size(); ++i)
+            if (keyAt(i, f) == key) result.push_back(touch(books[i]));
+        return result;
+    }
+    // Перевірка предиката; холодний запис повертається в пам'ять лише при збігу
+    template<typename Pred>
+    Book* testSlot(Slot& s, Pred& p) {
+        if (s.book) return p(*s.book) ? touch(s) : nullptr;
+        auto tmp = loadCold(s);
+        if (!p(*tmp)) return nullptr;
+        promote(s, move(tmp));
+        return touch(s);
+    }
+    void zoneAdd(size_t pos, const Book& b) {
+        if (pos / zoneRows >= zones.size()) zones.emplace_back();
+        Zone& z = zones[pos / zoneRows];
+        z.yearMin = min(z.yearMin, b.getYear());
+        z.yearMax = max(z.yearMax, b.getYear());
+        z.typeMask |= 1 << (int)b.type();
+        z.genreMin = min(z.genreMin, b.getGenreCode());
+        z.genreMax = max(z.genreMax, b.getGenreCode());
+    }
+
+    // Ключі знімаються під блокуванням, а сама хеш-таблиця будується без нього,
+    // тож запити тим часом обслуговуються скануванням. Індекс, що сам не вміщується в межу
+    // пам'яті, не будується
+    void buildIndex(IndexField f) {
+        LazyIndex& idx = indexes[(int)f];
+        vector<string> keys;
+        uint64_t epoch;
+        size_t budget;
+        {
+            lock_guard<mutex> lock(mtx);
+            if (idx.state != LazyIndex::Queued) return;
+            idx.state = LazyIndex::Building;
+            counters.indexBuilds++;
+            epoch = layoutEpoch;
+            budget = indexBudget;
+            keys.reserve(books.size());
+            for (size_t i = 0; i < books.size(); ++i) keys.push_back(keyAt(i, f));
+        }
+        size_t estimate = 0;
+        for (const string& k : keys) estimate += entryBytes(k);
+        if (estimate > budget) {
+            lock_guard<mutex> lock(mtx);
+            if (idx.state == LazyIndex::Building) {
+                idx.state = LazyIndex::Absent;
+                idx.overBudget = true;
+            }
+            return;
+        }
+        unordered_multimap<string, size_t> map;
+        map.reserve(keys.size());
+        size_t bytes = 0;
+        for (size_t i = 0; i < keys.size(); ++i) bytes += entryBytes(map.emplace(move(keys[i]), i)->first);
+        lock_guard<mutex> lock(mtx);
+        if (epoch != layoutEpoch) return;   // записи переставлено, позиції застаріли
+        for (size_t i = keys.size(); i < books.size(); ++i) bytes += entryBytes(map.emplace(keyAt(i, f), i)->first);   // додані під час побудови
+        idx.map = move(map);
+        idx.bytes = bytes;
+        idx.lastUse = ++useClock;           // щойно побудований індекс витісняється останнім
+        counters.indexEntries += idx.map.size();
+        counters.indexBytes += bytes;
+        idx.state = LazyIndex::Ready;
+        evictLocked(indexBudget);
+    }
+
+    // Ставить побудову в чергу; запит, що її спричинив, тим часом сканує
+    void requestBuildLocked(IndexField f) {
+        LazyIndex& idx = indexes[(int)f];
+        if (idx.state != LazyIndex::Absent || idx.overBudget) return;
+        idx.state = LazyIndex::Queued;
+        buildQueue.push_back(f);
+        if (builderRunning) return;
+        if (builder.joinable()) builder.join();   // попередній потік уже вийшов із циклу
+        builderRunning = true;
+        builder = thread([this] { runBuilds(); });
+    }
+    void runBuilds() {
+        unique_lock<mutex> lock(mtx);
+        while (!buildQueue.empty()) {
+            IndexField f = buildQueue.front();
+            buildQueue.pop_front();
+            lock.unlock();
+            buildIndex(f);
+            lock.lock();
+        }
+        builderRunning = false;
+        buildIdle.notify_all();
+    }
+public:
+    ~Catalog() {
+        {
+            lock_guard<mutex> lock(mtx);
+            buildQueue.clear();
+        }
+        if (builder.joinable()) builder.join();
+    }
+
+    void addBook(const Book& b) {
+        ScopedTimer timer(Operation::AddBook);
+        {
+            lock_guard<mutex> lock(mtx);
+            books.push_back(Slot{b.clone(), b.getId(), 0, -1, 0});
+            books.back().book->detached = false;
+            counters.resident++;
+            counters.bookBytes += books.back().book->bytes();
+            counters.slotBytes = books.capacity() * sizeof(Slot);
+            idInsert(b.getId(), (uint32_t)(books.size() - 1));
+            counters.idSlots = idTable.size();
+            counters.idTableBytes = idTable.size() * sizeof(IdSlot);
+            zoneAdd(books.size() - 1, b);
+            byType[(int)b.type()].push_back((uint32_t)(books.size() - 1));
+            if (learnedById) {
+                learnedById->insert(b.getId(), (uint32_t)(books.size() - 1));
+                learnedByYear->insert(b.getYear(), (uint32_t)(books.size() - 1));
+            }
+            double v;
+            for (int f = 0; f < 4; ++f)
+                if (crackers[f] && numericValue(b, (NumericField)f, v)) crackers[f]->append(v, (uint32_t)(books.size() - 1));
+            for (int f = 0; f < 3; ++f)
+                if (indexes[f].state == LazyIndex::Ready) {
+                    size_t bytes = entryBytes(indexes[f].map.emplace(keyOf(b, (IndexField)f), books.size() - 1)->first);
+                    indexes[f].bytes += bytes;
+                    counters.indexBytes += bytes;
+                    counters.indexEntries++;
+                }
+            evictLocked(indexBudget);
+        }
+        lock_guard<mutex> lock(listenerMutex);   // слухачі викликаються без блокування каталогу
+        for (auto& l : listeners) l.second(b);
+    }
+    void listAll(SortOrder order = SortOrder::None) const {
+        lock_guard<mutex> lock(mtx);
+        auto print = [this](size_t i) { if (books[i].book) books[i].book->printInfo(); else loadCold(books[i])->printInfo(); };
+        if (order == SortOrder::None) { for (size_t i = 0; i < books.size(); ++i) print(i); return; }
+        vector<string> keys;
+        keys.reserve(books.size());
+        for (size_t i = 0; i < books.size(); ++i)
+            keys.push_back(order == SortOrder::Title
+                           ? collationKey(keyAt(i, IndexField::Title))
+                           : collationKey(keyAt(i, IndexField::Author)) + '\x01' + collationKey(keyAt(i, IndexField::Title)));
+        for (size_t i : parallelRadixSort(keys)) print(i);
+    }
+
+    // Пошук за точним значенням поля; до готовності індексу — сканування,
+    // а побудова відсутнього індексу запускається у фоні
+    vector<Book*> findBy(IndexField f, const string& key) {
+        ScopedTimer timer(Operation::Search);
+        LazyIndex& idx = indexes[(int)f];
+        lock_guard<mutex> lock(mtx);
+        if (idx.state != LazyIndex::Ready) {
+            requestBuildLocked(f);
+            Metrics::instance().count(MetricCounter::IndexFallback);
+            return scanBy(f, key);
+        }
+        Metrics::instance().count(MetricCounter::IndexHit);
+        idx.lastUse = ++useClock;
+        vector<Book*> result;
+        auto range = idx.map.equal_range(key);
+        for (auto it = range.first; it != range.second; ++it) result.push_back(touch(books[it->second]));
+        return result;
+    }
+
+    // Фоновий прогрів індексів у заданому порядку пріоритету
+    void startWarming(const vector<IndexField>& priority) {
+        lock_guard<mutex> lock(mtx);
+        for (IndexField f : priority) requestBuildLocked(f);
+    }
+    // Чекає, доки черга фонових побудов спорожніє
+    void waitForIndexBuilds() {
+        unique_lock<mutex> lock(mtx);
+        buildIdle.wait(lock, [this] { return !builderRunning; });
+    }
+
+    size_t indexBytes() const { return counters.indexBytes.load(); }
+
+    // Під тиском пам'яті скидає найдавніше використані індекси; вони перебудуються при потребі
+    void evictIndexes(size_t budgetBytes) {
+        lock_guard<mutex> lock(mtx);
+        evictLocked(budgetBytes);
+    }
+    // Постійна межа: перевіряється після кожного додавання книги й побудови індексу
+    void setIndexBudget(size_t budgetBytes) {
+        lock_guard<mutex> lock(mtx);
+        indexBudget = budgetBytes;
+        for (auto& idx : indexes) idx.overBudget = false;   // нова межа може вмістити відкладені індекси
+        evictLocked(indexBudget);
+    }
+
+    Book* findById(int id) {
+        ScopedTimer timer(Operation::Search);
+        lock_guard<mutex> lock(mtx);
+        uint32_t pos = positionOf(id);
+        return pos == emptyPos ? nullptr : touch(books[pos]);
+    }
+
+    // Зміна книги під блокуванням каталогу, щоб паралельне винесення на диск не підмінило об'єкт
+    // посеред операції; f повертає bool, відсутня книга дає false
+    template<typename F>
+    bool update(int id, F f) {
+        lock_guard<mutex> lock(mtx);
+        uint32_t pos = positionOf(id);
+        return pos != emptyPos && f(*touch(books[pos]));
+    }
+
+    // Пакетне читання за id: спершу всі хеші з передвибіркою слотів таблиці,
+    // далі передвибірка записів і об'єктів книг, і лише потім звернення до них
+    vector<Book*> getMany(const int* ids, size_t n) {
+        ScopedTimer timer(Operation::Search);
+        lock_guard<mutex> lock(mtx);
+        vector<uint32_t> pos(n);
+        for (size_t i = 0; i < n; ++i) {
+            pos[i] = (uint32_t)idHome(ids[i]);
+            PREFETCH(&idTable[pos[i]]);
+        }
+        for (size_t i = 0; i < n; ++i) {
+            pos[i] = idProbe(pos[i], ids[i]);
+            if (pos[i] != emptyPos) PREFETCH(&books[pos[i]]);
+        }
+        for (size_t i = 0; i < n; ++i)
+            if (pos[i] != emptyPos && books[pos[i]].book) PREFETCH(books[pos[i]].book.get());
+        vector<Book*> result(n, nullptr);
+        for (size_t i = 0; i < n; ++i)
+            if (pos[i] != emptyPos) result[i] = touch(books[pos[i]]);
+        return result;
+    }
+    vector<Book*> getMany(const vector<int>& ids) { return getMany(ids.data(), ids.size()); }
+
+    // ===== Статичний поліморфізм через шаблонну функцію =====
+    template<typename Pred>
+    vector<Book*> search(Pred p) {
+        ScopedTimer timer(Operation::Search);
+        lock_guard<mutex> lock(mtx);
+        vector<Book*> result;
+        for (auto& s : books)
+            if (Book* b = testSlot(s, p)) result.push_back(b);
+        return result;
+    }
+
+    // Заморожує поточні записи: будує статичні індекси за id, роком і назвою
+    void freeze() {
+        lock_guard<mutex> lock(mtx);
+        vector<pair<int, uint32_t>> ids, years;
+        vector<pair<string, uint32_t>> titles;
+        for (size_t i = 0; i < books.size(); ++i)
+            withBook(books[i], [&](const Book& b) {
+                ids.emplace_back(b.getId(), (uint32_t)i);
+                years.emplace_back(b.getYear(), (uint32_t)i);
+                titles.emplace_back(b.getTitle(), (uint32_t)i);
+            });
+        frozen.byId = EytzingerIndex<int>(move(ids));
+        frozen.byYear = EytzingerIndex<int>(move(years));
+        frozen.byTitle = EytzingerIndex<string>(move(titles));
+        frozen.count = books.size();
+    }
+
+    // Впорядковані діапазони; для замороженої частини — статичні індекси
+    vector<Book*> idRange(int lo, int hi, size_t limit = SIZE_MAX) {
+        ScopedTimer timer(Operation::Search);
+        lock_guard<mutex> lock(mtx);
+        return orderedRange(frozen.byId, lo, [hi](int k) { return k <= hi; }, limit, [](const Book& b) { return b.getId(); });
+    }
+    vector<Book*> yearRange(int lo, int hi, size_t limit = SIZE_MAX) {
+        ScopedTimer timer(Operation::Search);
+        lock_guard<mutex> lock(mtx);
+        return orderedRange(frozen.byYear, lo, [hi](int k) { return k <= hi; }, limit, [](const Book& b) { return b.getYear(); });
+    }
+    // Назви від from за абеткою (байтове порівняння), не більше limit
+    vector<Book*> titlesFrom(const string& from, size_t limit) {
+        ScopedTimer timer(Operation::Search);
+        lock_guard<mutex> lock(mtx);
+        return orderedRange(frozen.byTitle, from, [](const string&) { return true; }, limit,
+                            [](const Book& b) { return b.getTitle(); });
+    }
+
+    // Вмикає навчені індекси за id і роком (вимикає — повернення до хеш-таблиці id)
+    void useLearnedIndexes(bool enable) {
+        lock_guard<mutex> lock(mtx);
+        if (enable) trainLearned();
+        else { learnedById.reset(); learnedByYear.reset(); }
+    }
+
+    vector<Book*> learnedYearRange(int lo, int hi) {
+        ScopedTimer timer(Operation::Search);
+        lock_guard<mutex> lock(mtx);
+        if (!learnedByYear) trainLearned();
+        vector<Book*> result;
+        for (uint32_t i : learnedByYear->range(lo, hi)) result.push_back(touch(books[i]));
+        return result;
+    }
+
+    size_t learnedModelBytes() const {
+        lock_guard<mutex> lock(mtx);
+        return learnedById ? learnedById->modelBytes() + learnedByYear->modelBytes() : 0;
+    }
+
+    // Діапазонний запит по числовому полю без явного індексу: кожен запит доупорядковує
+    // копію стовпця, тож повторювані запити наближаються до швидкості індексу
+    vector<Book*> crackRange(NumericField f, double lo, double hi) {
+        ScopedTimer timer(Operation::Search);
+        lock_guard<mutex> lock(mtx);
+        unique_ptr<CrackerColumn>& column = crackers[(int)f];
+        if (!column) {
+            vector<pair<double, uint32_t>> values;
+            const vector<uint32_t>* rows = f == NumericField::Pages ? &byType[(int)BookType::Printed]
+                                         : f == NumericField::SizeMB ? &byType[(int)BookType::EBook]
+                                         : f == NumericField::Duration ? &byType[(int)BookType::Audio] : nullptr;
+            auto add = [&](uint32_t i) {
+                withBook(books[i], [&](const Book& b) { double v; if (numericValue(b, f, v)) values.emplace_back(v, i); });
+            };
+            if (rows) for (uint32_t i : *rows) add(i);
+            else for (size_t i = 0; i < books.size(); ++i) add((uint32_t)i);
+            column = make_unique<CrackerColumn>(move(values));
+        }
+        vector<Book*> result;
+        for (uint32_t i : column->range(lo, hi)) result.push_back(touch(books[i]));
+        return result;
+    }
+
+    // Пошук лише серед книг підтипу T; предикат отримує const T& і звертається до полів
+    // підтипу напряму, без віртуальних викликів (підтипи позначені final)
+    template<typename T, typename Pred>
+    vector<T*> searchType(Pred p) {
+        ScopedTimer timer(Operation::Search);
+        lock_guard<mutex> lock(mtx);
+        auto typed = [&p](const Book& b) { return p(static_cast<const T&>(b)); };
+        vector<T*> result;
+        for (uint32_t pos : byType[(int)T::kind])
+            if (Book* b = testSlot(books[pos], typed)) result.push_back(static_cast<T*>(b));
+        return result;
+    }
+
+    // Сканування з пропуском блоків, чиї зонні карти не перетинаються з умовою
+    vector<Book*> scan(const ScanFilter& f) {
+        ScopedTimer timer(Operation::Search);
+        lock_guard<mutex> lock(mtx);
+        auto p = [&f](const Book& b) {
+            return b.getYear() >= f.yearMin && b.getYear() <= f.yearMax && (f.typeMask >> (int)b.type() & 1)
+                   && (f.genre < 0 || b.getGenreCode() == f.genre);
+        };
+        vector<Book*> result;
+        for (size_t z = 0; z < zones.size(); ++z) {
+            const Zone& zone = zones[z];
+            if (zone.yearMax < f.yearMin || zone.yearMin > f.yearMax || !(zone.typeMask & f.typeMask)) continue;
+            if (f.genre >= 0 && (f.genre < zone.genreMin || f.genre > zone.genreMax)) continue;
+            for (size_t i = z * zoneRows; i < min(books.size(), (z + 1) * zoneRows); ++i)
+                if (Book* b = testSlot(books[i], p)) result.push_back(b);
+        }
+        return result;
+    }
+
+    // Фізично впорядковує записи за підтипом, жанром, потім роком, щоб зонні карти стали
+    // вибірковими, а кожен підтип займав суцільний діапазон.
+    // Позиції змінюються, тож індекси скидаються й перебудуються при потребі
+    void cluster() {
+        lock_guard<mutex> lock(mtx);
+        vector<pair<uint32_t, size_t>> keys;
+        keys.reserve(books.size());
+        for (size_t i = 0; i < books.size(); ++i)
+            keys.emplace_back(withBook(books[i], [](const Book& b) {
+                return (uint32_t)b.type() << 24 | (uint32_t)b.getGenreCode() << 16 | (uint16_t)(b.getYear() + 32768);
+            }), i);
+        stable_sort(keys.begin(), keys.end(), [](const pair<uint32_t, size_t>& a, const pair<uint32_t, size_t>& b) { return a.first < b.first; });
+        vector<Slot> sorted;
+        sorted.reserve(books.size());
+        for (const auto& k : keys) sorted.push_back(move(books[k.second]));
+        books.swap(sorted);
+
+        layoutEpoch++;
+        frozen = FrozenSegment();
+        for (auto& c : crackers) c.reset();
+        if (learnedById) trainLearned();
+        for (auto& idx : indexes) dropIndex(idx);
+        idTable.assign(16, IdSlot{0, emptyPos});
+        idCount = 0;
+        zones.clear();
+        for (auto& part : byType) part.clear();
+        for (size_t i = 0; i < books.size(); ++i) {
+            idInsert(books[i].id, (uint32_t)i);
+            withBook(books[i], [&](const Book& b) {
+                zoneAdd(i, b);
+                byType[(int)b.type()].push_back((uint32_t)i);
+            });
+        }
+        counters.idSlots = idTable.size();
+        counters.idTableBytes = idTable.size() * sizeof(IdSlot);
+        counters.slotBytes = books.capacity() * sizeof(Slot);
+    }
+
+    // Переписує живі холодні записи в новий файл, коли сміття в сегменті більше, ніж даних.
+    // Старий файл замінюється лише після того, як новий відкрито; за будь-якої помилки
+    // лишається старий сегмент, а тимчасові файли видаляються
+    void compactSegmentLocked() {
+        if (segmentEnd - liveColdBytes <= liveColdBytes) return;
+        string tmpPath = segmentPath + ".tmp", oldPath = segmentPath + ".old";
+        ofstream out(tmpPath, ios::binary | ios::trunc);
+        if (!out) return;
+        vector<int64_t> offsets(books.size(), -1);
+        string buf;
+        uint64_t end = 0;
+        for (size_t i = 0; i < books.size(); ++i) {
+            const Slot& s = books[i];
+            if (s.book) continue;
+            buf.resize(s.coldBytes);
+            segment.clear();
+            segment.seekg(s.coldOffset);
+            if (!segment.read(&buf[0], buf.size())) { out.close(); remove(tmpPath.c_str()); return; }
+            offsets[i] = (int64_t)end;
+            out.write(buf.data(), buf.size());
+            end += buf.size();
+        }
+        out.close();
+        if (!out) { remove(tmpPath.c_str()); return; }
+        segment.close();
+        // Старий файл відкладається вбік, щоб його можна було повернути (rename не замінює файли на Windows)
+        bool setAside = rename(segmentPath.c_str(), oldPath.c_str()) == 0;
+        bool swapped = setAside && rename(tmpPath.c_str(), segmentPath.c_str()) == 0;
+        if (swapped) segment.open(segmentPath, ios::in | ios::out | ios::binary);
+        if (!swapped || !segment.is_open()) {
+            if (setAside) {
+                remove(segmentPath.c_str());
+                rename(oldPath.c_str(), segmentPath.c_str());
+            }
+            remove(tmpPath.c_str());
+            segment.clear();
+            segment.open(segmentPath, ios::in | ios::out | ios::binary);
+            return;
+        }
+        remove(oldPath.c_str());
+        for (size_t i = 0; i < books.size(); ++i) if (offsets[i] >= 0) books[i].coldOffset = offsets[i];
+        segmentEnd = end;
+    }
+
+    // Звільняє відкріплені об'єкти й повертає вільні сторінки купи системі
+    size_t releaseRetiredLocked() {
+        size_t n = retired.size();
+        for (const auto& b : retired) counters.bookBytes -= b->bytes();
+        vector<unique_ptr<Book>>().swap(retired);
+#ifdef __GLIBC__
+        if (n) malloc_trim(0);
+#endif
+        return n;
+    }
+
+    // Виносить у сегмент на диску книги з менш ніж minHits звернень; лічильники старіють удвічі.
+    // Покажчики на винесені книги відкріплюються й лишаються дійсними до наступного проходу
+    // або reclaim(); змінювати книгу між проходами слід через update(id, f)
+    size_t tierCold(const string& path, uint32_t minHits) {
+        lock_guard<mutex> lock(mtx);
+        releaseRetiredLocked();
+        if (path != segmentPath) {
+            for (auto& s : books) if (!s.book) touch(s);   // старий сегмент більше не використовується
+            if (segment.is_open()) segment.close();
+            segment.open(path, ios::in | ios::out | ios::binary | ios::trunc);
+            segmentPath = path;
+            segmentEnd = liveColdBytes = 0;
+        }
+        if (!segment.is_open()) return 0;
+        compactSegmentLocked();
+        size_t moved = 0;
+        segment.clear();
+        segment.seekp((streamoff)segmentEnd);
+        for (auto& s : books) {
+            if (s.book && s.hits < minHits) {
+                s.coldOffset = (int64_t)segmentEnd;
+                s.book->serialize(segment);
+                segmentEnd = (uint64_t)segment.tellp();
+                s.coldBytes = (uint32_t)(segmentEnd - s.coldOffset);
+                liveColdBytes += s.coldBytes;
+                s.book->detached = true;
+                retired.push_back(move(s.book));
+                moved++;
+            }
+            s.hits /= 2;
+        }
+        segment.flush();
+        counters.resident -= moved;
+        counters.cold += moved;
+        return moved;
+    }
+
+    // Звільняє об'єкти, винесені останнім tierCold, не чекаючи наступного проходу;
+    // після виклику старі покажчики на холодні книги недійсні
+    size_t reclaim() {
+        lock_guard<mutex> lock(mtx);
+        return releaseRetiredLocked();
+    }
+
+    uint64_t segmentBytes() const { lock_guard<mutex> lock(mtx); return segmentEnd; }
+
+    size_t addListener(function<void(const Book&)> f) {
+        lock_guard<mutex> lock(listenerMutex);
+        listeners.emplace(nextListener, move(f));
+        return nextListener++;
+    }
+    void removeListener(size_t token) {
+        lock_guard<mutex> lock(listenerMutex);
+        listeners.erase(token);
+    }
+
+    // Обхід усіх книг під блокуванням каталогу; холодні записи читаються тимчасово
+    template<typename F>
+    void forEach(F f) const {
+        lock_guard<mutex> lock(mtx);
+        for (const auto& s : books) withBook(s, [&f](const Book& b) { f(b); });
+    }
+
+    const Stats& stats() const { return counters; }
+
+    size_t coldCount() const {
+        lock_guard<mutex> lock(mtx);
+        return count_if(books.begin(), books.end(), [](const Slot& s) { return !s.book; });
+    }
+};
+
+// ===== Стиснені стовпці зі скануванням без декодування =====
+// Бітова карта результатів: по біту на рядок
+using RowBitmap = vector<uint64_t>;
+
+static void bitmapAnd(RowBitmap& a, const RowBitmap& b) {
+    for (size_t i = 0; i < a.size(); ++i) a[i] &= b[i];
+}
+
+// Значення v зберігається як (v - base) у width бітах; лінії не перетинають межу слова
+class BitPackedColumn {
+    vector<uint64_t> words;
+    int64_t base = 0;
+    unsigned width = 1, perWord = 64;
+    size_t rows = 0;
+public:
+    BitPackedColumn() = default;
+    explicit BitPackedColumn(const vector<int64_t>& values) : rows(values.size()) {
+        if (values.empty()) return;
+        auto mm = minmax_element(values.begin(), values.end());
+        base = *mm.first;
+        uint64_t range = (uint64_t)(*mm.second - base);
+        while (width < 64 && range >> width) ++width;
+        perWord = 64 / width;
+        words.assign((rows + perWord - 1) / perWord, 0);
+        for (size_t i = 0; i < rows; ++i)
+            words[i / perWord] |= (uint64_t)(values[i] - base) << (i % perWord * width);
+    }
+    // Межі перекладаються в простір кодів один раз, далі порівнюються лише коди
+    RowBitmap between(int64_t lo, int64_t hi) const {
+        RowBitmap out((rows + 63) / 64, 0);
+        if (hi < base || lo > hi) return out;
+        uint64_t clo = lo <= base ? 0 : (uint64_t)(lo - base), chi = (uint64_t)(hi - base);
+        uint64_t mask = width == 64 ? ~0ULL : (1ULL << width) - 1;
+        for (size_t w = 0, row = 0; w < words.size(); ++w) {
+            uint64_t word = words[w];
+            for (unsigned lane = 0; lane < perWord && row < rows; ++lane, ++row) {
+                uint64_t c = word >> (lane * width) & mask;
+                if (c >= clo && c <= chi) out[row / 64] |= 1ULL << (row % 64);
+            }
+        }
+        return out;
+    }
+    int64_t at(size_t row) const {
+        uint64_t mask = width == 64 ? ~0ULL : (1ULL << width) - 1;
+        return base + (int64_t)(words[row / perWord] >> (row % perWord * width) & mask);
+    }
+    size_t bytes() const { return words.size() * sizeof(uint64_t); }
+};
+
+// Серії однакових значень (значення, кінець серії)
+class RleColumn {
+    vector<pair<uint8_t, uint32_t>> runs;
+    size_t rows = 0;
+public:
+    RleColumn() = default;
+    explicit RleColumn(const vector<uint8_t>& values) : rows(values.size()) {
+        for (size_t i = 0; i < values.size(); ++i) {
+            if (runs.empty() || runs.back().first != values[i]) runs.emplace_back(values[i], (uint32_t)i);
+            runs.back().second = (uint32_t)i + 1;
+        }
+    }
+    // Предикат обчислюється раз на серію, а не на рядок
+    RowBitmap inMask(uint8_t valueMask) const {
+        RowBitmap out((rows + 63) / 64, 0);
+        uint32_t start = 0;
+        for (const auto& r : runs) {
+            if (valueMask >> r.first & 1)
+                for (uint32_t i = start; i < r.second; ++i) out[i / 64] |= 1ULL << (i % 64);
+            start = r.second;
+        }
+        return out;
+    }
+    size_t bytes() const { return runs.size() * sizeof(runs[0]); }
+};
+
+// Словник наявних значень + бітово упаковані номери в словнику
+class DictionaryColumn {
+    vector<GenreCode> dict;
+    BitPackedColumn codes;
+    size_t rows = 0;
+public:
+    DictionaryColumn() = default;
+    explicit DictionaryColumn(const vector<GenreCode>& values) : rows(values.size()) {
+        dict = values;
+        sort(dict.begin(), dict.end());
+        dict.erase(unique(dict.begin(), dict.end()), dict.end());
+        vector<int64_t> ids(values.size());
+        for (size_t i = 0; i < values.size(); ++i)
+            ids[i] = lower_bound(dict.begin(), dict.end(), values[i]) - dict.begin();
+        codes = BitPackedColumn(ids);
+    }
+    RowBitmap equals(GenreCode v) const {
+        auto it = lower_bound(dict.begin(), dict.end(), v);
+        if (it == dict.end() || *it != v) return RowBitmap((rows + 63) / 64, 0);
+        int64_t id = it - dict.begin();
+        return codes.between(id, id);
+    }
+    size_t bytes() const { return dict.size() + codes.bytes(); }
+};
+
+// Знімок каталогу у стовпцевому стисненому вигляді; після змін каталогу будується заново
+class ColumnStore {
+    BitPackedColumn ids, years, available;
+    RleColumn types;
+    DictionaryColumn genres;
+    size_t rows = 0;
+public:
+    explicit ColumnStore(const Catalog& catalog) {
+        vector<int64_t> id, year, avail;
+        vector<uint8_t> type;
+        vector<GenreCode> genre;
+        catalog.forEach([&](const Book& b) {
+            id.push_back(b.getId());
+            year.push_back(b.getYear());
+            avail.push_back(b.isAvailable());
+            type.push_back((uint8_t)b.type());
+            genre.push_back(b.getGenreCode());
+        });
+        rows = id.size();
+        ids = BitPackedColumn(id);
+        years = BitPackedColumn(year);
+        available = BitPackedColumn(avail);
+        types = RleColumn(type);
+        genres = DictionaryColumn(genre);
+    }
+
+    // Повертає id книг, що задовольняють фільтр; усі умови перевіряються на кодах
+    vector<int> select(const ScanFilter& f, bool onlyAvailable = false) const {
+        RowBitmap m = years.between(f.yearMin, f.yearMax);
+        bitmapAnd(m, types.inMask(f.typeMask));
+        if (f.genre >= 0) bitmapAnd(m, genres.equals((GenreCode)f.genre));
+        if (onlyAvailable) bitmapAnd(m, available.between(1, 1));
+        vector<int> result;
+        for (size_t w = 0; w < m.size(); ++w)
+            for (uint64_t bits = m[w]; bits; bits &= bits - 1)
+                result.push_back((int)ids.at(w * 64 + lowestBit(bits)));
+        return result;
+    }
+
+    size_t bytes() const { return ids.bytes() + years.bytes() + available.bytes() + types.bytes() + genres.bytes(); }
+    size_t size() const { return rows; }
+};
+
+// ===== Повнотекстовий пошук у вмісті електронних книг =====
+// Файл книги — <directory>/<id>.txt. Індекс складається з незмінних сегментів з
+// позиційними списками; нові книги дають нові сегменти, фоновий потік зливає дрібні
+class ContentIndex {
+    struct Posting {
+        int doc;
+        vector<uint32_t> positions;
+    };
+    using Segment = unordered_map<string, vector<Posting>>;   // списки впорядковані за doc
+
+    Catalog& catalog;
+    string directory;
+    size_t maxSegments;
+    size_t listenerToken;
+    mutable mutex mtx;
+    vector<shared_ptr<const Segment>> segments;
+    unordered_set<int> claimed;     // книги, які вже взяв у роботу слухач або indexCatalog
+    mutex mergeMutex;               // злиття виконує один потік за раз
+    mutex queueMutex;
+    condition_variable queueCv, idleCv;
+    deque<int> pendingDocs;
+    bool stopping = false, busy = false;
+    thread worker;
+    atomic<uint64_t> bytes{0}, docs{0};
+
+    static vector<string> tokenize(const string& text) {
+        vector<string> tokens;
+        string cur;
+        for (unsigned char c : text) {
+            if (isalnum(c) || c >= 0x80) cur += (char)tolower(c);
+            else if (!cur.empty()) { tokens.push_back(move(cur)); cur.clear(); }
+        }
+        if (!cur.empty()) tokens.push_back(move(cur));
+        return tokens;
+    }
+
+    // Лишає тільки книги, яких ще ніхто не індексував: нова книга може прийти і від слухача,
+    // і з обходу каталогу
+    vector<int> claim(const vector<int>& ids) {
+        vector<int> fresh;
+        lock_guard<mutex> lock(mtx);
+        for (int id : ids) if (claimed.insert(id).second) fresh.push_back(id);
+        return fresh;
+    }
+    // Книгу без файлу знімають із claimed: наступний indexCatalog або слухач спробує знову
+    void release(int id) {
+        lock_guard<mutex> lock(mtx);
+        claimed.erase(id);
+    }
+
+    shared_ptr<const Segment> buildSegment(const vector<int>& candidates) {
+        vector<int> ids = claim(candidates);
+        sort(ids.begin(), ids.end());
+        auto seg = make_shared<Segment>();
+        for (int id : ids) {
+            ifstream in(directory + "/" + to_string(id) + ".txt", ios::binary);
+            if (!in) { release(id); continue; }
+            string text((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+            if (in.bad()) { release(id); continue; }
+            bytes += text.size();
+            docs++;
+            vector<string> tokens = tokenize(text);
+            for (uint32_t pos = 0; pos < tokens.size(); ++pos) {
+                vector<Posting>& list = (*seg)[tokens[pos]];
+                if (list.empty() || list.back().doc != id) list.push_back(Posting{id, {}});
+                list.back().positions.push_back(pos);
+            }
+        }
+        return seg;
+    }
+
+    static shared_ptr<const Segment> mergeSegments(const Segment& a, const Segment& b) {
+        auto out = make_shared<Segment>(a);
+        for (const auto& term : b) {
+            vector<Posting>& dst = (*out)[term.first];
+            vector<Posting> merged;
+            merged.reserve(dst.size() + term.second.size());
+            merge(dst.begin(), dst.end(), term.second.begin(), term.second.end(), back_inserter(merged),
+                  [](const Posting& x, const Posting& y) { return x.doc < y.doc; });
+            dst.swap(merged);
+        }
+        return out;
+    }
+
+    void publish(shared_ptr<const Segment> seg) {
+        if (seg->empty()) return;
+        lock_guard<mutex> lock(mtx);
+        segments.push_back(move(seg));
+    }
+
+    // Зливає два найменші сегменти, поки їх більше за maxSegments; запити тим часом
+    // працюють зі старим набором, бо сегменти незмінні. Без mergeMutex фоновий потік
+    // і indexCatalog могли б злити ту саму пару двічі
+    void compact() {
+        lock_guard<mutex> merging(mergeMutex);
+        while (true) {
+            shared_ptr<const Segment> a, b;
+            {
+                lock_guard<mutex> lock(mtx);
+                if (segments.size() <= maxSegments) return;
+                vector<shared_ptr<const Segment>> bySize = segments;
+                sort(bySize.begin(), bySize.end(), [](const shared_ptr<const Segment>& x, const shared_ptr<const Segment>& y) { return x->size() < y->size(); });
+                a = bySize[0];
+                b = bySize[1];
+            }
+            auto merged = mergeSegments(*a, *b);
+            lock_guard<mutex> lock(mtx);
+            segments.erase(remove_if(segments.begin(), segments.end(),
+                                     [&](const shared_ptr<const Segment>& x) { return x == a || x == b; }), segments.end());
+            segments.push_back(move(merged));
+        }
+    }
+
+    void run() {
+        unique_lock<mutex> lock(queueMutex);
+        while (true) {
+            queueCv.wait(lock, [this] { return stopping || !pendingDocs.empty(); });
+            if (pendingDocs.empty()) return;
+            vector<int> batch(pendingDocs.begin(), pendingDocs.end());
+            pendingDocs.clear();
+            busy = true;
+            lock.unlock();
+            publish(buildSegment(batch));
+            compact();
+            lock.lock();
+            busy = false;
+            idleCv.notify_all();
+        }
+    }
+
+    vector<shared_ptr<const Segment>> snapshot() const {
+        lock_guard<mutex> lock(mtx);
+        return segments;
+    }
+    static const vector<Posting>* postings(const Segment& seg, const string& term) {
+        auto it = seg.find(term);
+        return it == seg.end() ? nullptr : &it->second;
+    }
+    static const Posting* postingFor(const vector<Posting>& list, int doc) {
+        auto it = lower_bound(list.begin(), list.end(), doc, [](const Posting& p, int d) { return p.doc < d; });
+        return it != list.end() && it->doc == doc ? &*it : nullptr;
+    }
+public:
+    ContentIndex(Catalog& c, string dir, size_t maxSegs = 8) : catalog(c), directory(move(dir)), maxSegments(max<size_t>(2, maxSegs)) {
+        worker = thread([this] { run(); });
+        listenerToken = catalog.addListener([this](const Book& b) {
+            if (b.type() != BookType::EBook) return;
+            lock_guard<mutex> lock(queueMutex);
+            pendingDocs.push_back(b.getId());
+            queueCv.notify_one();
+        });
+    }
+    ~ContentIndex() {
+        catalog.removeListener(listenerToken);
+        {
+            lock_guard<mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueCv.notify_one();
+        worker.join();
+    }
+
+    // Паралельно індексує всі електронні книги, що вже є в каталозі
+    void indexCatalog(size_t threads = thread::hardware_concurrency()) {
+        vector<int> ids;
+        catalog.forEach([&ids](const Book& b) { if (b.type() == BookType::EBook) ids.push_back(b.getId()); });
+        threads = max<size_t>(1, min(threads, ids.size()));
+        vector<thread> pool;
+        for (size_t t = 0; t < threads; ++t)
+            pool.emplace_back([&, t] {
+                vector<int> part;
+                for (size_t i = t; i < ids.size(); i += threads) part.push_back(ids[i]);
+                publish(buildSegment(part));
+            });
+        for (auto& th : pool) th.join();
+        compact();
+    }
+
+    // Чекає, доки фоновий потік обробить нові книги
+    void waitIdle() {
+        unique_lock<mutex> lock(queueMutex);
+        idleCv.wait(lock, [this] { return pendingDocs.empty() && !busy; });
+    }
+
+    // Книги, що містять слова фрази поспіль
+    vector<int> phrase(const string& text) const {
+        vector<string> terms = tokenize(text);
+        vector<int> result;
+        if (terms.empty()) return result;
+        for (const auto& seg : snapshot()) {
+            vector<const vector<Posting>*> lists;
+            for (const string& t : terms) lists.push_back(postings(*seg, t));
+            if (find(lists.begin(), lists.end(), nullptr) != lists.end()) continue;
+            for (const Posting& first : *lists[0]) {
+                vector<const Posting*> ps{&first};
+                for (size_t i = 1; i < lists.size() && ps.size() == i; ++i)
+                    if (const Posting* p = postingFor(*lists[i], first.doc)) ps.push_back(p);
+                if (ps.size() != terms.size()) continue;
+                for (uint32_t start : first.positions) {
+                    size_t i = 1;
+                    while (i < ps.size() && binary_search(ps[i]->positions.begin(), ps[i]->positions.end(), start + (uint32_t)i)) ++i;
+                    if (i == ps.size()) { result.push_back(first.doc); break; }
+                }
+            }
+        }
+        sort(result.begin(), result.end());
+        result.erase(unique(result.begin(), result.end()), result.end());
+        return result;
+    }
+
+    // Книги, де слова a і b трапляються не далі ніж через window слів
+    vector<int> near(const string& a, const string& b, uint32_t window) const {
+        vector<int> result;
+        vector<string> ka = tokenize(a), kb = tokenize(b);
+        if (ka.size() != 1 || kb.size() != 1) return result;
+        const string& ta = ka[0];
+        const string& tb = kb[0];
+        for (const auto& seg : snapshot()) {
+            const vector<Posting>* la = postings(*seg, ta);
+            const vector<Posting>* lb = postings(*seg, tb);
+            if (!la || !lb) continue;
+            for (const Posting& pa : *la) {
+                const Posting* pb = postingFor(*lb, pa.doc);
+                if (!pb) continue;
+                size_t i = 0, j = 0;
+                while (i < pa.positions.size() && j < pb->positions.size()) {
+                    uint32_t x = pa.positions[i], y = pb->positions[j];
+                    if ((x > y ? x - y : y - x) <= window) { result.push_back(pa.doc); break; }
+                    if (x < y) ++i; else ++j;
+                }
+            }
+        }
+        sort(result.begin(), result.end());
+        result.erase(unique(result.begin(), result.end()), result.end());
+        return result;
+    }
+
+    size_t segmentCount() const { lock_guard<mutex> lock(mtx); return segments.size(); }
+    uint64_t bytesIndexed() const { return bytes.load(); }
+    uint64_t documentsIndexed() const { return docs.load(); }
+};
+
+// ===== Шар запитів: кеш результатів і об'єднання однакових запитів у польоті =====
+// Перший запит з ключем виконується, решта чекають на його shared_future.
+// Результат — id книг, бо об'єкти холодних книг можуть бути вивантажені
+class SearchService {
+public:
+    using Result = shared_ptr<const vector<int>>;
+private:
+    struct CacheEntry {
+        Result value;
+        chrono::steady_clock::time_point expires;
+        list<string>::iterator lruPos;
+    };
+    Catalog& catalog;
+    size_t capacity;
+    chrono::milliseconds ttl;
+    size_t listenerToken;
+    mutex mtx;
+    uint64_t generation = 0;        // зростає з кожним invalidate
+    unordered_map<string, shared_future<Result>> inflight;
+    unordered_map<string, CacheEntry> cache;
+    list<string> lru;               // спереду — найсвіжіше використані
+
+    static string normalize(IndexField f, const string& value) {
+        size_t b = value.find_first_not_of(" \t"), e = value.find_last_not_of(" \t");
+        return to_string((int)f) + '|' + (b == string::npos ? string() : value.substr(b, e - b + 1));
+    }
+
+    void store(const string& key, const Result& r) {
+        auto it = cache.find(key);
+        if (it != cache.end()) { lru.erase(it->second.lruPos); cache.erase(it); }
+        lru.push_front(key);
+        cache.emplace(key, CacheEntry{r, chrono::steady_clock::now() + ttl, lru.begin()});
+        while (cache.size() > capacity) { cache.erase(lru.back()); lru.pop_back(); }
+    }
+public:
+    SearchService(Catalog& c, size_t cacheCapacity = 1024, chrono::milliseconds cacheTtl = chrono::milliseconds(500))
+        : catalog(c), capacity(max<size_t>(1, cacheCapacity)), ttl(cacheTtl) {
+        listenerToken = catalog.addListener([this](const Book&) { invalidate(); });
+    }
+    ~SearchService() { catalog.removeListener(listenerToken); }
+
+    Result find(IndexField f, const string& value) {
+        string key = normalize(f, value);
+        promise<Result> leader;
+        shared_future<Result> pending;
+        uint64_t startedAt;
+        {
+            lock_guard<mutex> lock(mtx);
+            startedAt = generation;
+            auto hit = cache.find(key);
+            if (hit != cache.end() && hit->second.expires > chrono::steady_clock::now()) {
+                lru.splice(lru.begin(), lru, hit->second.lruPos);
+                Metrics::instance().count(MetricCounter::QueryCacheHit);
+                return hit->second.value;
+            }
+            auto it = inflight.find(key);
+            if (it != inflight.end()) pending = it->second;
+            else inflight.emplace(key, leader.get_future().share());
+        }
+        if (pending.valid()) {
+            Metrics::instance().count(MetricCounter::QueryCoalesced);
+            return pending.get();
+        }
+        Metrics::instance().count(MetricCounter::QueryExecuted);
+        Result r;
+        try {
+            auto ids = make_shared<vector<int>>();
+            for (Book* b : catalog.findBy(f, key.substr(key.find('|') + 1))) ids->push_back(b->getId());
+            r = ids;
+        } catch (...) {
+            lock_guard<mutex> lock(mtx);
+            if (generation == startedAt) inflight.erase(key);
+            leader.set_exception(current_exception());
+            throw;
+        }
+        {
+            // Якщо каталог змінився під час запиту, результат міг застаріти: його отримають
+            // лише ті, хто вже чекав, а в кеш і в inflight він не потрапляє
+            lock_guard<mutex> lock(mtx);
+            if (generation == startedAt) {
+                store(key, r);
+                inflight.erase(key);
+            }
+        }
+        leader.set_value(r);
+        return r;
+    }
+
+    // Скидає кеш після змін каталогу (викликається слухачем каталогу). Запити в польоті
+    // завершуються для своїх очікувачів, а нові запити стартують заново
+    void invalidate() {
+        lock_guard<mutex> lock(mtx);
+        generation++;
+        cache.clear();
+        lru.clear();
+        inflight.clear();
+    }
+};
+
+// ===== Фільтр Блума для відсікання розділів =====
+class BloomFilter {
+    vector<uint64_t> bits;
+    size_t entries = 0;
+    static const int hashes = 7;    // оптимум для ~10 біт на ключ
+
+    static uint64_t mix(uint64_t h) {
+        h ^= h >> 33; h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33; h *= 0xc4ceb9fe1a85ec53ULL;
+        return h ^ (h >> 33);
+    }
+public:
+    explicit BloomFilter(size_t expected = 1024) : bits(max<size_t>(1, expected * 10 / 64 + 1)) {}
+    void add(const string& key) {
+        uint64_t h1 = hash<string>()(key), h2 = mix(h1) | 1;
+        size_t m = bits.size() * 64;
+        for (int i = 0; i < hashes; ++i) {
+            size_t b = (h1 + i * h2) % m;
+            bits[b / 64] |= 1ULL << (b % 64);
+        }
+        entries++;
+    }
+    bool mayContain(const string& key) const {
+        uint64_t h1 = hash<string>()(key), h2 = mix(h1) | 1;
+        size_t m = bits.size() * 64;
+        for (int i = 0; i < hashes; ++i) {
+            size_t b = (h1 + i * h2) % m;
+            if (!(bits[b / 64] >> (b % 64) & 1)) return false;
+        }
+        return true;
+    }
+    size_t size() const { return entries; }
+    size_t capacity() const { return bits.size() * 64 / 10; }
+};
+
+// ===== Каталог, розбитий на розділи за id, з маршрутизацією через фільтри =====
+class PartitionedCatalog {
+    struct Partition {
+        Catalog catalog;
+        mutex filterMutex;          // фільтр змінюють addBook, а читають паралельні findBy
+        BloomFilter filter;
+    };
+    vector<unique_ptr<Partition>> parts;
+    atomic<size_t> queries{0}, contacted{0};
+
+    static string filterKey(IndexField f, const string& key) { return (f == IndexField::Title ? "t:" : f == IndexField::Author ? "a:" : "g:") + key; }
+    static void addKeys(BloomFilter& filter, const Book& b) {
+        filter.add(filterKey(IndexField::Title, b.getTitle()));
+        filter.add(filterKey(IndexField::Author, b.getAuthor().getName()));
+        filter.add(filterKey(IndexField::Genre, b.getGenre()));
+    }
+    Partition& partitionOf(int id) { return *parts[(unsigned)id % parts.size()]; }
+public:
+    explicit PartitionedCatalog(size_t n) {
+        for (size_t i = 0; i < max<size_t>(1, n); ++i) parts.push_back(make_unique<Partition>());
+    }
+
+    // Фільтр оновлюється інкрементно; при переповненні — перебудова вдвічі більшого.
+    // Перебудова обходить каталог через forEach: без лічильників звернень, метрик пошуку
+    // й повернення холодних записів у пам'ять.
+    // Книга й ключі фільтра додаються під одним замком: пошук не побачить книгу без ключів
+    void addBook(const Book& b) {
+        Partition& p = partitionOf(b.getId());
+        lock_guard<mutex> lock(p.filterMutex);
+        p.catalog.addBook(b);
+        if (p.filter.size() + 3 > p.filter.capacity()) {
+            BloomFilter bigger(p.filter.capacity() * 2);
+            p.catalog.forEach([&bigger](const Book& x) { addKeys(bigger, x); });
+            p.filter = move(bigger);
+        } else addKeys(p.filter, b);
+    }
+
+    Book* findById(int id) { return partitionOf(id).catalog.findById(id); }
+
+    vector<Book*> findBy(IndexField f, const string& key) {
+        vector<Book*> result;
+        string fk = filterKey(f, key);
+        queries++;
+        for (auto& p : parts) {
+            {
+                lock_guard<mutex> lock(p->filterMutex);
+                if (!p->filter.mayContain(fk)) continue;
+            }
+            contacted++;
+            auto part = p->catalog.findBy(f, key);
+            result.insert(result.end(), part.begin(), part.end());
+        }
+        return result;
+    }
+
+    // Середня кількість опитаних розділів на запит
+    double averageFanOut() const { return queries ? (double)contacted / queries : 0.0; }
+    size_t partitionCount() const { return parts.size(); }
+};
+
+// ===== Компактна таблиця користувачів =====
+// Стовпці з тегом ролі замість окремих об'єктів у купі; ліміт зберігається числом,
+// тож масові перевірки — це цикл без розгалужень, який компілятор векторизує.
+// Користувача бібліотеки позначає номер рядка; рядки лише додаються
+enum class UserRole : uint8_t { Student, Librarian };
+using UserRow = uint32_t;
+const UserRow noUser = UINT32_MAX;
+
+class UserTable {
+    // Фрагмент спільного буфера тексту
+    struct Text {
+        uint32_t offset, length;
+    };
+    struct StudentInfo {
+        Text faculty;
+        int32_t yearStudy;
+    };
+    vector<UserRole> roles;
+    vector<int32_t> borrowed;
+    vector<int32_t> limits;
+    vector<Text> names;
+    vector<uint32_t> detail;        // рядок у побічній таблиці своєї ролі
+    vector<StudentInfo> students;
+    vector<Text> employeeIds;
+    string arena;                   // імена, факультети й табельні номери підряд, без окремих виділень
+    // Індекс імен: відкрита адресація за хешем тексту в arena, лише номери рядків (noUser — порожньо)
+    vector<UserRow> nameSlots;
+    size_t namesIndexed = 0;
+
+    static size_t nameHash(const char* p, size_t n) {
+        uint64_t h = 1469598103934665603ull;   // FNV-1a
+        for (size_t i = 0; i < n; ++i) h = (h ^ (uint8_t)p[i]) * 1099511628211ull;
+        return (size_t)h;
+    }
+    bool nameIs(UserRow r, const char* p, size_t n) const {
+        return names[r].length == n && arena.compare(names[r].offset, n, p, n) == 0;
+    }
+    // Слот із цим ім'ям або перший порожній
+    size_t nameSlot(const char* p, size_t n) const {
+        size_t mask = nameSlots.size() - 1, i = nameHash(p, n) & mask;
+        while (nameSlots[i] != noUser && !nameIs(nameSlots[i], p, n)) i = (i + 1) & mask;
+        return i;
+    }
+    // Дублікат імені не індексується: find повертає перший рядок
+    void indexName(UserRow r) {
+        if ((namesIndexed + 1) * 2 > nameSlots.size()) {
+            vector<UserRow> old = move(nameSlots);
+            nameSlots.assign(max<size_t>(16, old.size() * 2), noUser);
+            for (UserRow x : old)
+                if (x != noUser) nameSlots[nameSlot(arena.data() + names[x].offset, names[x].length)] = x;
+        }
+        size_t i = nameSlot(arena.data() + names[r].offset, names[r].length);
+        if (nameSlots[i] == noUser) { nameSlots[i] = r; namesIndexed++; }
+    }
+
+    Text intern(const string& s) {
+        Text t{(uint32_t)arena.size(), (uint32_t)s.size()};
+        arena += s;
+        return t;
+    }
+    string text(Text t) const { return arena.substr(t.offset, t.length); }
+
+    UserRow append(UserRole r, const string& n, int32_t limit, uint32_t d) {
+        roles.push_back(r);
+        borrowed.push_back(0);
+        limits.push_back(limit);
+        names.push_back(intern(n));
+        detail.push_back(d);
+        UserRow row = (UserRow)(roles.size() - 1);
+        indexName(row);
+        return row;
+    }
+public:
+    static const int32_t studentLimit = 5;
+
+    UserRow addStudent(const string& n, const string& f, int y) {
+        students.push_back(StudentInfo{intern(f), y});
+        return append(UserRole::Student, n, studentLimit, (uint32_t)students.size() - 1);
+    }
+    UserRow addLibrarian(const string& n, const string& id) {
+        employeeIds.push_back(intern(id));
+        return append(UserRole::Librarian, n, INT32_MAX, (uint32_t)employeeIds.size() - 1);
+    }
+
+    size_t size() const { return roles.size(); }
+    bool contains(UserRow row) const { return row < roles.size(); }
+    UserRole role(UserRow row) const { return roles[row]; }
+    string name(UserRow row) const { return text(names[row]); }
+    int32_t borrowedBy(UserRow row) const { return borrowed[row]; }
+    bool canBorrow(UserRow row) const { return borrowed[row] < limits[row]; }
+    void borrow(UserRow row) { borrowed[row]++; }
+    void giveBack(UserRow row) { if (borrowed[row] > 0) borrowed[row]--; }
+
+    // Перший рядок з таким ім'ям або noUser
+    UserRow find(const string& name) const {
+        if (nameSlots.empty()) return noUser;
+        return nameSlots[nameSlot(name.data(), name.size())];
+    }
+
+    void show(UserRow row) const {
+        if (roles[row] == UserRole::Student) {
+            const StudentInfo& s = students[detail[row]];
+            cout << name(row) << " - Student, " << text(s.faculty) << ", year " << s.yearStudy << "\n";
+        } else {
+            cout << name(row) << " - Librarian, ID: " << text(employeeIds[detail[row]]) << "\n";
+        }
+    }
+
+    // eligible[i] = 1, якщо i-й користувач ще може брати книги
+    void eligibility(vector<uint8_t>& eligible) const {
+        size_t n = borrowed.size();
+        eligible.resize(n);
+        const int32_t* b = borrowed.data();
+        const int32_t* l = limits.data();
+        uint8_t* out = eligible.data();
+        for (size_t i = 0; i < n; ++i) out[i] = (uint8_t)(b[i] < l[i]);
+    }
+
+    size_t countAtLimit() const {
+        size_t n = borrowed.size(), count = 0;
+        const int32_t* b = borrowed.data();
+        const int32_t* l = limits.data();
+        for (size_t i = 0; i < n; ++i) count += b[i] >= l[i];
+        return count;
+    }
+
+    vector<UserRow> atLimit() const {
+        vector<uint8_t> eligible;
+        eligibility(eligible);
+        vector<UserRow> rows;
+        for (size_t i = 0; i < eligible.size(); ++i) if (!eligible[i]) rows.push_back((UserRow)i);
+        return rows;
+    }
+
+    size_t bytes() const {
+        return roles.capacity() * sizeof(UserRole) + (borrowed.capacity() + limits.capacity()) * sizeof(int32_t)
+             + detail.capacity() * sizeof(uint32_t) + (names.capacity() + employeeIds.capacity()) * sizeof(Text)
+             + students.capacity() * sizeof(StudentInfo) + arena.capacity() + nameSlots.capacity() * sizeof(UserRow);
+    }
+};
+
+// Класи користувачів для окремих об'єктів (наприклад, у шардах): кожен тримає свої дані сам
+class User {
+protected:
+    string name;
+    int borrowed;
+public:
+    User(string n) : name(move(n)), borrowed(0) {}
+    virtual ~User() = default;
+    virtual void showRole() const = 0;        // динамічний поліморфізм
+    virtual bool canBorrow() const = 0;
+    void borrowBook() { borrowed++; }
+    void returnBook() { if (borrowed>0) borrowed--; }
+    string getName() const { return name; }
+    int getBorrowed() const { return borrowed; }
+};
+
+class Student : public User {
+    string faculty;
+    int yearStudy;
+public:
+    Student(string n, string f, int y) : User(move(n)), faculty(move(f)), yearStudy(y) {}
+    void showRole() const override {
+        cout << name << " - Student, " << faculty << ", year " << yearStudy << "\n";
+    }
+    bool canBorrow() const override { return borrowed < UserTable::studentLimit; }
+};
+
+class Librarian : public User {
+    string employeeId;
+public:
+    Librarian(string n, string id) : User(move(n)), employeeId(move(id)) {}
+    void showRole() const override {
+        cout << name << " - Librarian, ID: " << employeeId << "\n";
+    }
+    bool canBorrow() const override { return true; }
+};
+
+// Фасад рядка таблиці (Library::user): два поля, передається за значенням без виділень пам'яті.
+// Роль береться з таблиці, тож віртуальні виклики не потрібні
+class UserView {
+    UserTable* table = nullptr;
+    UserRow row = noUser;
+public:
+    UserView() = default;
+    UserView(UserTable& t, UserRow r) : table(&t), row(r) {}
+    explicit operator bool() const { return table && table->contains(row); }
+    UserRow tableRow() const { return row; }
+    UserRole role() const { return table->role(row); }
+    void showRole() const { table->show(row); }
+    bool canBorrow() const { return table->canBorrow(row); }
+    void borrowBook() { table->borrow(row); }
+    void returnBook() { table->giveBack(row); }
+    string getName() const { return table->name(row); }
+    int getBorrowed() const { return table->borrowedBy(row); }
+};
+
+// ===== Кільце "один виробник — один споживач" без блокувань =====
+template<typename T>
+class SpscRing {
+    vector<T> buf;
+    size_t mask;
+    atomic<size_t> head;            // рухає споживач
+    char pad[64 - sizeof(atomic<size_t>)];
+    atomic<size_t> tail;            // рухає виробник
+public:
+    explicit SpscRing(size_t capacity) : head(0), tail(0) {
+        size_t c = 1;
+        while (c < capacity) c <<= 1;
+        buf.resize(c);
+        mask = c - 1;
+    }
+    // Значення забирається лише при успіху: після відмови його можна подати ще раз
+    template<typename U>
+    bool push(U&& v) {
+        size_t t = tail.load(memory_order_relaxed);
+        if (t - head.load(memory_order_acquire) == buf.size()) return false;
+        buf[t & mask] = forward<U>(v);
+        tail.store(t + 1, memory_order_release);
+        return true;
+    }
+    bool pop(T& v) {
+        size_t h = head.load(memory_order_relaxed);
+        if (h == tail.load(memory_order_acquire)) return false;
+        v = move(buf[h & mask]);
+        head.store(h + 1, memory_order_release);
+        return true;
+    }
+    size_t size() const { return tail.load(memory_order_acquire) - head.load(memory_order_acquire); }
+};
+
+// Сон споживача без пропущених сигналів: виробник дзвонить (ring) після запису, споживач
+// при простої чекає (wait), доки ready() або не пролунає новий дзвінок. Обидві сторони роблять
+// RMW над state, тож або споживач побачить запис, або виробник побачить біт сну й розбудить його
+class Doorbell {
+    mutex mtx;
+    condition_variable cv;
+    atomic<uint64_t> state{0};     // (кількість дзвінків << 1) | споживач засинає
+public:
+    void ring() {
+        if (!(state.fetch_add(2, memory_order_acq_rel) & 1)) return;
+        lock_guard<mutex> lock(mtx);
+        cv.notify_one();
+    }
+    template<typename Ready>
+    void wait(Ready ready) {
+        uint64_t seen = state.fetch_or(1, memory_order_acq_rel) >> 1;
+        {
+            unique_lock<mutex> lock(mtx);
+            cv.wait(lock, [&] { return ready() || state.load(memory_order_acquire) >> 1 != seen; });
+        }
+        state.fetch_and(~(uint64_t)1, memory_order_relaxed);
+    }
+};
+
+// ===== Асинхронний журнал аудиту =====
+enum class AuditAction : uint8_t { AddBook, Checkout, Checkin, AddStudent, AddLibrarian };
+
+struct AuditConfig {
+    string directory = ".";
+    string prefix = "audit";
+    size_t bufferEntries = 4096;                    // місткість буфера кожного потоку
+    size_t rotateBytes = 1 << 20;                   // розмір файлу до ротації
+    chrono::milliseconds flushInterval{50};
+    size_t maxDropped = 0;                          // скільки записів дозволено втратити при переповненні; далі — очікування
+};
+
+class AuditLog {
+    struct Entry {
+        time_t time;
+        AuditAction action;
+        int32_t bookId;
+        uint32_t actor;         // номер в інтернованих іменах: запис не виділяє пам'ять
+    };
+    // Буфер потоку і його кеш імен → номер; кеш читає лише сам потік
+    struct ThreadBuffer {
+        SpscRing<Entry> ring;
+        unordered_map<string, uint32_t> actors;
+        explicit ThreadBuffer(size_t capacity) : ring(capacity) {}
+    };
+    AuditConfig cfg;
+    const uint64_t instanceId;
+    mutex registryMutex;
+    vector<unique_ptr<ThreadBuffer>> buffers;
+    // Інтерновані імена виконавців, спільні для всіх потоків; лише додаються
+    mutex internMutex;
+    unordered_map<string, uint32_t> internIds;
+    deque<string> internNames;
+    atomic<size_t> dropped{0};
+    atomic<bool> stopping{false};
+    mutex wakeMutex;
+    condition_variable wake;
+    thread writer;
+    // Стан поточного файлу: словник виконавців і дельта часу скидаються при ротації
+    ofstream out;
+    size_t fileIndex = 0, fileBytes = 0;
+    time_t lastTime = 0;
+    unordered_map<uint32_t, uint32_t> actorIds;   // інтернований номер → номер у файлі
+
+    static uint64_t nextInstanceId() { static atomic<uint64_t> n{0}; return ++n; }
+
+    // Буфер потоку для цього журналу. Потік, що чергує кілька журналів, отримує по одному
+    // буферу на журнал; номери журналів не повторюються, тож записи мертвих журналів не збігаються
+    ThreadBuffer& localBuffer() {
+        thread_local uint64_t lastOwner = 0;
+        thread_local ThreadBuffer* last = nullptr;
+        if (lastOwner == instanceId) return *last;
+        thread_local unordered_map<uint64_t, ThreadBuffer*> perLog;
+        ThreadBuffer*& buffer = perLog[instanceId];
+        if (!buffer) {
+            lock_guard<mutex> lock(registryMutex);
+            buffers.push_back(make_unique<ThreadBuffer>(cfg.bufferEntries));
+            buffer = buffers.back().get();
+        }
+        lastOwner = instanceId;
+        last = buffer;
+        return *buffer;
+    }
+
+    // Номер імені: зі свого кешу без блокувань, інакше з глобальної таблиці
+    uint32_t actorId(ThreadBuffer& local, const string& actor) {
+        auto it = local.actors.find(actor);
+        if (it != local.actors.end()) return it->second;
+        uint32_t id;
+        {
+            lock_guard<mutex> lock(internMutex);
+            auto global = internIds.emplace(actor, (uint32_t)internNames.size());
+            if (global.second) internNames.push_back(actor);
+            id = global.first->second;
+        }
+        local.actors.emplace(actor, id);
+        return id;
+    }
+
+    static void putVarint(string& out, uint64_t v) {
+        while (v >= 0x80) { out += (char)(v | 0x80); v >>= 7; }
+        out += (char)v;
+    }
+
+    void openNext() {
+        if (out.is_open()) out.close();
+        out.open(cfg.directory + "/" + cfg.prefix + "." + to_string(fileIndex++) + ".log", ios::binary | ios::trunc);
+        fileBytes = 0;
+        lastTime = 0;
+        actorIds.clear();
+    }
+
+    // Компактне кодування пакета: варінт-дельти часу, словник виконавців, zigzag для id.
+    // Ротація перевіряється перед кожним записом з урахуванням ще не скинутої частини пакета
+    void writeBatch(const vector<Entry>& batch) {
+        string chunk;
+        for (const Entry& e : batch) {
+            if (!out.is_open() || fileBytes + chunk.size() >= cfg.rotateBytes) {
+                out.write(chunk.data(), chunk.size());
+                fileBytes += chunk.size();
+                chunk.clear();
+                openNext();
+            }
+            uint64_t delta = e.time >= lastTime ? (uint64_t)(e.time - lastTime) << 1 : (uint64_t)(lastTime - e.time) << 1 | 1;
+            putVarint(chunk, delta);
+            lastTime = e.time;
+            chunk += (char)e.action;
+            auto it = actorIds.find(e.actor);
+            if (it != actorIds.end()) putVarint(chunk, it->second + 1);
+            else {
+                actorIds.emplace(e.actor, (uint32_t)actorIds.size());
+                putVarint(chunk, 0);
+                lock_guard<mutex> lock(internMutex);
+                const string& name = internNames[e.actor];
+                putVarint(chunk, name.size());
+                chunk += name;
+            }
+            putVarint(chunk, (uint32_t)((e.bookId << 1) ^ (e.bookId >> 31)));
+        }
+        out.write(chunk.data(), chunk.size());
+        out.flush();
+        fileBytes += chunk.size();
+    }
+
+    void drain() {
+        vector<Entry> batch;
+        {
+            lock_guard<mutex> lock(registryMutex);
+            Entry e;
+            for (auto& b : buffers)
+                while (b->ring.pop(e)) batch.push_back(e);
+        }
+        if (batch.empty()) return;
+        stable_sort(batch.begin(), batch.end(), [](const Entry& a, const Entry& b) { return a.time < b.time; });
+        writeBatch(batch);
+    }
+
+    void run() {
+        while (!stopping.load()) {
+            {
+                unique_lock<mutex> lock(wakeMutex);
+                wake.wait_for(lock, cfg.flushInterval, [this] { return stopping.load(); });
+            }
+            drain();
+        }
+        drain();
+    }
+public:
+    explicit AuditLog(AuditConfig c = AuditConfig()) : cfg(move(c)), instanceId(nextInstanceId()) {
+        writer = thread([this] { run(); });
+    }
+    // Прапорець і сигнал під м'ютексом: інакше письменник може пропустити сигнал і чекати flushInterval
+    ~AuditLog() {
+        {
+            lock_guard<mutex> lock(wakeMutex);
+            stopping = true;
+            wake.notify_one();
+        }
+        writer.join();
+    }
+
+    // Гарячий шлях: лише запис у буфер свого потоку
+    void record(AuditAction action, const string& actor, int bookId = 0) {
+        Entry e;
+        e.time = time(nullptr);
+        e.action = action;
+        e.bookId = bookId;
+        ThreadBuffer& local = localBuffer();
+        e.actor = actorId(local, actor);
+        while (!local.ring.push(e)) {
+            // Перевірка межі й інкремент — одна атомарна операція, інакше потоки разом її перевищать
+            size_t d = dropped.load(memory_order_relaxed);
+            while (d < cfg.maxDropped)
+                if (dropped.compare_exchange_weak(d, d + 1)) return;
+            wake.notify_one();
+            this_thread::yield();
+        }
+    }
+
+    size_t droppedCount() const { return dropped.load(); }
+    size_t bufferCount() { lock_guard<mutex> lock(registryMutex); return buffers.size(); }
+};
+
+struct TitleDemand {
+    string title;
+    int available = 0;   // примірники на полиці
+    int holds = 0;       // резервування в черзі
+};
+
+class Library {
+    Catalog catalog;
+    UserTable userTable;
+    int nextBookId = 1;
+    // Історія стану для запитів "на момент часу"
+    unordered_map<int, Versioned<bool>> availabilityLog;
+    unordered_map<UserRow, Versioned<int>> loanLog;
+    unordered_map<int, deque<UserRow>> holds;   // черги резервувань виданих книг
+    unordered_map<int, UserRow> borrowers;      // хто тримає видану книгу
+    AuditLog* audit = nullptr;
+
+    bool queuedElsewhere(int bookId, UserRow u) const {
+        auto it = holds.find(bookId);
+        return it != holds.end() && it->second.front() != u;
+    }
+public:
+    Catalog& getCatalog() { return catalog; }
+    void setAudit(AuditLog* a) { audit = a; }
+
+    void addBook(const Book& b) {
+        catalog.addBook(b);
+        if (audit) audit->record(AuditAction::AddBook, "system", b.getId());
+    }
+
+    // Книгу з чергою резервувань може взяти лише перший у черзі; тоді його резерв знімається
+    bool checkout(UserRow u, int bookId, time_t t = time(nullptr)) {
+        ScopedTimer timer(Operation::Borrow);
+        if (!userTable.contains(u) || queuedElsewhere(bookId, u)) return false;
+        if (!userTable.canBorrow(u) || !catalog.update(bookId, [](Book& b) { return b.borrow(); })) return false;
+        if (holds.count(bookId)) popHold(bookId);
+        borrowers[bookId] = u;
+        userTable.borrow(u);
+        availabilityLog.emplace(bookId, Versioned<bool>(true)).first->second.set(t, false);
+        loanLog[u].set(t, userTable.borrowedBy(u));
+        if (audit) audit->record(AuditAction::Checkout, userTable.name(u), bookId);
+        return true;
+    }
+
+    // Повернути книгу може лише той, хто її взяв
+    bool checkin(UserRow u, int bookId, time_t t = time(nullptr)) {
+        ScopedTimer timer(Operation::Return);
+        auto holder = borrowers.find(bookId);
+        if (holder == borrowers.end() || holder->second != u) return false;
+        if (!catalog.update(bookId, [](Book& b) { if (b.isAvailable()) return false; b.returnBook(); return true; })) return false;
+        borrowers.erase(holder);
+        userTable.giveBack(u);
+        availabilityLog.emplace(bookId, Versioned<bool>(true)).first->second.set(t, true);
+        loanLog[u].set(t, userTable.borrowedBy(u));
+        if (audit) audit->record(AuditAction::Checkin, userTable.name(u), bookId);
+        return true;
+    }
+
+    // Резервування можливе лише на видану книгу, не її власнику і не вдруге
+    bool placeHold(UserRow u, int bookId) {
+        if (!userTable.contains(u)) return false;
+        auto holder = borrowers.find(bookId);
+        if (holder == borrowers.end() || holder->second == u) return false;
+        deque<UserRow>& queue = holds[bookId];
+        if (find(queue.begin(), queue.end(), u) != queue.end()) return false;
+        queue.push_back(u);
+        return true;
+    }
+
+    // Перший у черзі на книгу або noUser
+    UserRow nextHold(int bookId) const {
+        auto it = holds.find(bookId);
+        return it == holds.end() ? noUser : it->second.front();
+    }
+
+    // Знімає першого з черги (наприклад, коли він уже не може позичати) і повертає його або noUser
+    UserRow popHold(int bookId) {
+        auto it = holds.find(bookId);
+        if (it == holds.end() || it->second.empty()) return noUser;
+        UserRow u = it->second.front();
+        it->second.pop_front();
+        if (it->second.empty()) holds.erase(it);
+        return u;
+    }
+
+    size_t holdQueueLength(int bookId) const {
+        auto it = holds.find(bookId);
+        return it == holds.end() ? 0 : it->second.size();
+    }
+
+    // Попит по назвах для планувальника переміщень між філіями
+    vector<TitleDemand> demandSnapshot() const {
+        unordered_map<string, TitleDemand> byTitle;
+        catalog.forEach([&](const Book& b) {
+            TitleDemand& d = byTitle[b.getTitle()];
+            if (b.isAvailable()) d.available++;
+            d.holds += (int)holdQueueLength(b.getId());
+        });
+        vector<TitleDemand> out;
+        out.reserve(byTitle.size());
+        for (auto& kv : byTitle) {
+            kv.second.title = kv.first;
+            out.push_back(move(kv.second));
+        }
+        return out;
+    }
+
+    bool wasAvailable(int bookId, time_t t) const {
+        auto it = availabilityLog.find(bookId);
+        return it == availabilityLog.end() || it->second.at(t);
+    }
+
+    int borrowedAt(UserRow u, time_t t) const {
+        auto it = loanLog.find(u);
+        return it == loanLog.end() ? 0 : it->second.at(t);
+    }
+
+    UserRow findUser(const string& name) const { return userTable.find(name); }
+
+    // Фасад користувача за значенням; для неіснуючого рядка — порожній (false)
+    UserView user(UserRow u) { return userTable.contains(u) ? UserView(userTable, u) : UserView(); }
+
+    int newBookId() { return nextBookId++; }
+
+    // Повертають номер рядка, а не Student*/Librarian*: окремих об'єктів користувачів більше немає
+    UserRow addStudent(const string& n, const string& f, int y) {
+        ScopedTimer timer(Operation::RegisterUser);
+        UserRow u = userTable.addStudent(n, f, y);
+        if (audit) audit->record(AuditAction::AddStudent, n);
+        return u;
+    }
+
+    UserRow addLibrarian(const string& n, const string& id) {
+        ScopedTimer timer(Operation::RegisterUser);
+        UserRow u = userTable.addLibrarian(n, id);
+        if (audit) audit->record(AuditAction::AddLibrarian, n);
+        return u;
+    }
+
+    void listUsers() const {
+        for (uint32_t r = 0; r < userTable.size(); ++r) userTable.show(r);
+    }
+
+    const UserTable& getUserTable() const { return userTable; }
+
+    // Користувачі, які вичерпали ліміт видачі
+    vector<UserRow> usersAtLimit() const { return userTable.atLimit(); }
+};
+
+// ===== Планувальник переміщень примірників між філіями =====
+// Для кожної назви надлишок (вільні примірники понад чергу) однієї філії покриває
+// нестачу іншої; задача перевезення розв'язується мінімальним потоком мінімальної
+// вартості. Назви незалежні, тож розподіляються між потоками
+struct Transfer {
+    string title;
+    size_t from, to;   // індекси філій
+    int copies;
+};
+
+class TransferPlanner {
+    // Мінімальний потік для однієї назви: вузли 0 — джерело, 1 — стік, далі філії
+    struct Edge { int to, cap; double cost; };
+    struct FlowGraph {
+        vector<Edge> edges;
+        vector<vector<int>> adj;
+        explicit FlowGraph(size_t n) : adj(n) {}
+        void add(int u, int v, int cap, double cost) {
+            adj[u].push_back((int)edges.size());
+            edges.push_back(Edge{v, cap, cost});
+            adj[v].push_back((int)edges.size());
+            edges.push_back(Edge{u, 0, -cost});
+        }
+        // Послідовні найкоротші шляхи (SPFA, бо є від'ємні зворотні ребра)
+        void solve(int s, int t) {
+            size_t n = adj.size();
+            vector<double> dist(n);
+            vector<int> via(n);
+            vector<char> queued(n);
+            while (true) {
+                fill(dist.begin(), dist.end(), 1e300);
+                fill(via.begin(), via.end(), -1);
+                deque<int> q{s};
+                dist[s] = 0;
+                while (!q.empty()) {
+                    int u = q.front();
+                    q.pop_front();
+                    queued[u] = 0;
+                    for (int e : adj[u]) {
+                        const Edge& ed = edges[e];
+                        if (ed.cap > 0 && dist[u] + ed.cost < dist[ed.to] - 1e-12) {
+                            dist[ed.to] = dist[u] + ed.cost;
+                            via[ed.to] = e;
+                            if (!queued[ed.to]) { queued[ed.to] = 1; q.push_back(ed.to); }
+                        }
+                    }
+                }
+                if (via[t] < 0) return;
+                int push = INT_MAX;
+                for (int v = t; v != s; v = edges[via[v] ^ 1].to) push = min(push, edges[via[v]].cap);
+                for (int v = t; v != s; v = edges[via[v] ^ 1].to) {
+                    edges[via[v]].cap -= push;
+                    edges[via[v] ^ 1].cap += push;
+                }
+            }
+        }
+    };
+
+    vector<vector<double>> cost;   // вартість перевезення між філіями
+
+    double costOf(size_t from, size_t to) const {
+        return cost.empty() ? 1.0 : cost[from][to];
+    }
+
+    void planTitle(const string& title, const vector<pair<size_t, int>>& net, vector<Transfer>& out) const {
+        vector<pair<size_t, int>> surplus, deficit;
+        for (const auto& b : net) (b.second > 0 ? surplus : deficit).push_back(b);
+        if (surplus.empty() || deficit.empty()) return;
+        FlowGraph g(2 + surplus.size() + deficit.size());
+        int firstDeficit = 2 + (int)surplus.size();
+        for (size_t i = 0; i < surplus.size(); ++i) g.add(0, 2 + (int)i, surplus[i].second, 0);
+        for (size_t j = 0; j < deficit.size(); ++j) g.add(firstDeficit + (int)j, 1, -deficit[j].second, 0);
+        size_t firstRoute = g.edges.size();
+        for (size_t i = 0; i < surplus.size(); ++i)
+            for (size_t j = 0; j < deficit.size(); ++j)
+                g.add(2 + (int)i, firstDeficit + (int)j, INT_MAX, costOf(surplus[i].first, deficit[j].first));
+        g.solve(0, 1);
+        size_t e = firstRoute;
+        for (size_t i = 0; i < surplus.size(); ++i)
+            for (size_t j = 0; j < deficit.size(); ++j, e += 2) {
+                int moved = g.edges[e ^ 1].cap;
+                if (moved > 0) out.push_back(Transfer{title, surplus[i].first, deficit[j].first, moved});
+            }
+    }
+public:
+    TransferPlanner() = default;
+    explicit TransferPlanner(vector<vector<double>> branchCost) : cost(move(branchCost)) {}
+
+    // branches[i] — знімок попиту i-ї філії (Library::demandSnapshot)
+    vector<Transfer> plan(const vector<vector<TitleDemand>>& branches, size_t threads = thread::hardware_concurrency()) const {
+        ScopedTimer timer(Operation::TransferPlan);
+        unordered_map<string, vector<pair<size_t, int>>> byTitle;
+        for (size_t br = 0; br < branches.size(); ++br)
+            for (const TitleDemand& d : branches[br]) {
+                int net = d.available - d.holds;
+                if (net != 0) byTitle[d.title].emplace_back(br, net);
+            }
+        vector<const pair<const string, vector<pair<size_t, int>>>*> work;
+        for (const auto& kv : byTitle)
+            if (kv.second.size() > 1) work.push_back(&kv);
+
+        threads = max<size_t>(1, min(threads, work.size()));
+        vector<vector<Transfer>> parts(threads);
+        vector<thread> pool;
+        atomic<size_t> next{0};
+        const size_t chunk = 256;
+        for (size_t t = 0; t < threads; ++t)
+            pool.emplace_back([&, t] {
+                for (size_t begin; (begin = next.fetch_add(chunk)) < work.size();)
+                    for (size_t i = begin; i < min(begin + chunk, work.size()); ++i)
+                        planTitle(work[i]->first, work[i]->second, parts[t]);
+            });
+        for (auto& th : pool) th.join();
+
+        vector<Transfer> result;
+        for (auto& p : parts) result.insert(result.end(), p.begin(), p.end());
+        sort(result.begin(), result.end(), [](const Transfer& a, const Transfer& b) {
+            return tie(a.title, a.from, a.to) < tie(b.title, b.from, b.to);
+        });
+        return result;
+    }
+
+    double totalCost(const vector<Transfer>& plan) const {
+        double sum = 0;
+        for (const Transfer& t : plan) sum += costOf(t.from, t.to) * t.copies;
+        return sum;
+    }
+};
+
+// ===== Дискретно-подієвий симулятор семестру на справжніх Library/Catalog =====
+// Віртуальний час іде стрибками між подіями, тож семестр проганяється за секунди.
+// Однакове зерно дає однаковий результат
+struct SimulationConfig {
+    uint32_t seed = 42;
+    double days = 120;
+    size_t students = 2000;
+    size_t titles = 5000;
+    double visitsPerHour = 150;     // приходи студентів з пошуком за назвою
+    double popularitySkew = 1.0;    // показник Ципфа для вибору назв
+    double meanLoanDays = 14;
+};
+
+struct SimulationReport {
+    size_t events = 0, searches = 0, borrows = 0, returns = 0;
+    size_t deniedByLimit = 0, holdsPlaced = 0, holdsFulfilled = 0, holdsAbandoned = 0;
+    size_t maxHoldQueue = 0;
+    double meanHoldWaitDays = 0, p95HoldWaitDays = 0, meanHoldQueueAtPlace = 0;
+    double virtualDays = 0, wallSeconds = 0;
+
+    void print(ostream& os) const {
+        os << fixed << setprecision(2)
+           << "Simulated " << virtualDays << " days in " << wallSeconds << " s ("
+           << (wallSeconds > 0 ? events / wallSeconds : 0) << " events/s, "
+           << (wallSeconds > 0 ? virtualDays * 86400 / wallSeconds : 0) << "x real time)\n"
+           << "Searches: " << searches << ", borrows: " << borrows << ", returns: " << returns << "\n"
+           << "Denied by borrow limit: " << deniedByLimit << " (" << (searches ? 100.0 * deniedByLimit / searches : 0) << "%)\n"
+           << "Holds placed: " << holdsPlaced << ", fulfilled: " << holdsFulfilled << ", abandoned: " << holdsAbandoned << "\n"
+           << "Hold queue: max " << maxHoldQueue << ", mean length on arrival " << meanHoldQueueAtPlace << "\n"
+           << "Hold wait: mean " << meanHoldWaitDays << " days, p95 " << p95HoldWaitDays << " days\n";
+    }
+};
+
+class LibrarySimulator {
+    enum class EventKind : uint8_t { Visit, Return };
+    struct Event {
+        double time;                // віртуальні секунди від початку семестру
+        uint64_t seq;               // для детермінованого порядку рівночасних подій
+        EventKind kind;
+        size_t student;
+        int bookId;
+        bool operator>(const Event& o) const { return time != o.time ? time > o.time : seq > o.seq; }
+    };
+    SimulationConfig cfg;
+    Library lib;
+    vector<UserRow> students;
+    unordered_map<UserRow, size_t> studentIndex;
+    vector<string> titles;
+    vector<int> bookIds;
+    vector<double> popularityCdf;
+    mt19937 rng;
+    priority_queue<Event, vector<Event>, greater<Event>> events;
+    uint64_t nextSeq = 0;
+    map<pair<UserRow, int>, double> holdPlacedAt;
+    time_t epoch;
+
+    void schedule(double t, EventKind k, size_t student, int bookId = 0) {
+        events.push(Event{t, nextSeq++, k, student, bookId});
+    }
+    double exponential(double mean) { return exponential_distribution<double>(1.0 / mean)(rng); }
+    time_t at(double t) const { return epoch + (time_t)t; }
+
+    void borrowed(double now, size_t student, int bookId, SimulationReport& r) {
+        r.borrows++;
+        schedule(now + exponential(cfg.meanLoanDays * 86400), EventKind::Return, student, bookId);
+    }
+public:
+    explicit LibrarySimulator(SimulationConfig c) : cfg(c), rng(c.seed), epoch(time(nullptr)) {
+        cfg.students = max<size_t>(1, cfg.students);   // розподіли нижче потребують непорожніх множин
+        cfg.titles = max<size_t>(1, cfg.titles);
+        double total = 0;
+        for (size_t i = 0; i < cfg.titles; ++i) {
+            titles.push_back("Title " + to_string(i));
+            int id = lib.newBookId();
+            lib.addBook(PrintedBook(id, titles.back(), Author("Author " + to_string(i % 997)), 1950 + (int)(i % 70),
+                                    fixedGenres[i % fixedGenreCount], 100 + (int)(i % 400)));
+            bookIds.push_back(id);
+            total += 1.0 / pow((double)(i + 1), cfg.popularitySkew);
+            popularityCdf.push_back(total);
+        }
+        for (double& p : popularityCdf) p /= total;
+        for (size_t i = 0; i < cfg.students; ++i) {
+            students.push_back(lib.addStudent("Student " + to_string(i), "Faculty " + to_string(i % 12), 1 + (int)(i % 5)));
+            studentIndex[students.back()] = i;
+        }
+    }
+
+    SimulationReport run() {
+        SimulationReport r;
+        auto wallStart = chrono::steady_clock::now();
+        const double end = cfg.days * 86400;
+        uniform_real_distribution<double> uniform(0.0, 1.0);
+        uniform_int_distribution<size_t> anyStudent(0, students.size() - 1);
+        vector<double> waits;
+        double queueSum = 0;
+        schedule(exponential(3600 / cfg.visitsPerHour), EventKind::Visit, anyStudent(rng));
+
+        while (!events.empty() && events.top().time <= end) {
+            Event e = events.top();
+            events.pop();
+            r.events++;
+            UserRow s = students[e.student];
+            if (e.kind == EventKind::Visit) {
+                schedule(e.time + exponential(3600 / cfg.visitsPerHour), EventKind::Visit, anyStudent(rng));
+                size_t t = lower_bound(popularityCdf.begin(), popularityCdf.end(), uniform(rng)) - popularityCdf.begin();
+                r.searches++;
+                auto found = lib.getCatalog().findBy(IndexField::Title, titles[min(t, titles.size() - 1)]);
+                if (found.empty()) continue;
+                int bookId = found.front()->getId();
+                if (!lib.getUserTable().canBorrow(s)) { r.deniedByLimit++; continue; }
+                if (lib.checkout(s, bookId, at(e.time))) { borrowed(e.time, e.student, bookId, r); continue; }
+                if (holdPlacedAt.count({s, bookId})) continue;
+                queueSum += lib.holdQueueLength(bookId);
+                if (lib.placeHold(s, bookId)) {
+                    r.holdsPlaced++;
+                    holdPlacedAt[{s, bookId}] = e.time;
+                    r.maxHoldQueue = max(r.maxHoldQueue, lib.holdQueueLength(bookId));
+                }
+            } else {
+                lib.checkin(s, e.bookId, at(e.time));
+                r.returns++;
+                // Книга переходить першому в черзі, хто ще може позичати; решта втрачають резерв
+                for (UserRow next; (next = lib.nextHold(e.bookId)) != noUser;) {
+                    auto placed = holdPlacedAt.find({next, e.bookId});
+                    double since = placed->second;
+                    holdPlacedAt.erase(placed);
+                    if (lib.checkout(next, e.bookId, at(e.time))) {
+                        r.holdsFulfilled++;
+                        waits.push_back((e.time - since) / 86400);
+                        borrowed(e.time, studentIndex[next], e.bookId, r);
+                        break;
+                    }
+                    lib.popHold(e.bookId);
+                    r.holdsAbandoned++;
+                }
+            }
+        }
+        r.virtualDays = cfg.days;
+        r.wallSeconds = chrono::duration<double>(chrono::steady_clock::now() - wallStart).count();
+        r.meanHoldQueueAtPlace = r.holdsPlaced ? queueSum / r.holdsPlaced : 0;
+        if (!waits.empty()) {
+            sort(waits.begin(), waits.end());
+            double sum = 0;
+            for (double w : waits) sum += w;
+            r.meanHoldWaitDays = sum / waits.size();
+            r.p95HoldWaitDays = waits[min(waits.size() - 1, (size_t)(waits.size() * 0.95))];
+        }
+        return r;
+    }
+};
+
+// ===== Конвеєр мутацій: parse → validate → apply → log → respond =====
+// Кожна стадія — окремий потік, що бере з вхідного SPSC-кільця пакет і обробляє його цілком.
+// Поки конвеєр працює, Library змінює лише стадія apply.
+// Формат команд: book|P/E/A|назва|автор|рік|жанр|сторінки/МБ/години, student|ім'я|факультет|курс,
+// borrow|ім'я|id книги, return|ім'я|id книги
+class MutationPipeline {
+public:
+    using Responder = function<void(uint64_t seq, bool ok, const string& error)>;
+private:
+    enum class Kind : uint8_t { Invalid, AddBook, AddStudent, Borrow, Return };
+    struct Mutation {
+        uint64_t seq = 0;
+        string line;
+        Kind kind = Kind::Invalid;
+        vector<string> fields;
+        int year = 0, number = 0;   // рік книги; сторінки, курс студента або id книги
+        double amount = 0;          // МБ чи години для EBook/AudioBook
+        bool ok = false;
+        string error;
+    };
+    static const int stageCount = 5;
+
+    Library& lib;
+    ostream& log;
+    Responder respond;
+    size_t batchSize;
+    vector<unique_ptr<SpscRing<Mutation>>> rings;   // rings[i] — вхід стадії i
+    Doorbell bells[stageCount];                     // bells[i] будить стадію i, коли в її вході щось з'явилось
+    atomic<bool> stageDone[stageCount + 1];         // [0] — вхід закрито
+    vector<thread> workers;
+    uint64_t nextSeq = 0;
+
+    // Числа поза діапазоном int відкидаються тут, щоб apply не кидав винятків у своєму потоці
+    static bool toInt(const string& s, int& v) {
+        char* end = nullptr;
+        long long n = strtoll(s.c_str(), &end, 10);
+        if (s.empty() || *end != '\0' || n < INT_MIN || n > INT_MAX) return false;
+        v = (int)n;
+        return true;
+    }
+    static bool toDouble(const string& s, double& v) {
+        char* end = nullptr;
+        v = strtod(s.c_str(), &end);
+        return !s.empty() && *end == '\0' && isfinite(v);
+    }
+
+    static void parse(vector<Mutation>& batch) {
+        for (Mutation& m : batch) {
+            size_t start = 0, bar;
+            while ((bar = m.line.find('|', start)) != string::npos) { m.fields.push_back(m.line.substr(start, bar - start)); start = bar + 1; }
+            m.fields.push_back(m.line.substr(start));
+            const string& cmd = m.fields[0];
+            m.kind = cmd == "book" ? Kind::AddBook : cmd == "student" ? Kind::AddStudent
+                   : cmd == "borrow" ? Kind::Borrow : cmd == "return" ? Kind::Return : Kind::Invalid;
+            if (m.kind == Kind::Invalid) m.error = "unknown command";
+        }
+    }
+
+    // Перевірки, що не залежать від стану бібліотеки; розібрані числа лишаються в мутації
+    static void validate(vector<Mutation>& batch) {
+        for (Mutation& m : batch) {
+            if (m.kind == Kind::Invalid) continue;
+            const vector<string>& f = m.fields;
+            bool valid = false;
+            if (m.kind == Kind::AddBook)
+                valid = f.size() == 7 && f[1].size() == 1 && string("PEA").find(f[1][0]) != string::npos && !f[2].empty()
+                        && toInt(f[4], m.year)
+                        && (f[1] == "P" ? toInt(f[6], m.number) && m.number > 0 : toDouble(f[6], m.amount) && m.amount > 0);
+            else if (m.kind == Kind::AddStudent) valid = f.size() == 4 && !f[1].empty() && toInt(f[3], m.number) && m.number > 0;
+            else valid = f.size() == 3 && !f[1].empty() && toInt(f[2], m.number);
+            if (!valid) { m.kind = Kind::Invalid; m.error = "malformed arguments"; }
+        }
+    }
+
+    // Мутації застосовуються по черзі; користувач знаходиться через індекс імен таблиці
+    void apply(vector<Mutation>& batch) {
+        for (Mutation& m : batch) {
+            const vector<string>& f = m.fields;
+            switch (m.kind) {
+                case Kind::Invalid: continue;
+                case Kind::AddBook: {
+                    int id = lib.newBookId();
+                    if (f[1] == "P") lib.addBook(PrintedBook(id, f[2], Author(f[3]), m.year, f[5], m.number));
+                    else if (f[1] == "E") lib.addBook(EBook(id, f[2], Author(f[3]), m.year, f[5], m.amount));
+                    else lib.addBook(AudioBook(id, f[2], Author(f[3]), m.year, f[5], m.amount));
+                    m.ok = true;
+                    break;
+                }
+                case Kind::AddStudent:
+                    lib.addStudent(f[1], f[2], m.number);
+                    m.ok = true;
+                    break;
+                case Kind::Borrow:
+                case Kind::Return: {
+                    UserRow u = lib.findUser(f[1]);
+                    if (u == noUser) { m.error = "unknown user"; break; }
+                    m.ok = m.kind == Kind::Borrow ? lib.checkout(u, m.number) : lib.checkin(u, m.number);
+                    if (!m.ok) m.error = "not possible";
+                    break;
+                }
+            }
+        }
+    }
+
+    // Журнал пакета дописується одним записом і одним flush
+    void writeLog(vector<Mutation>& batch) {
+        string chunk;
+        for (const Mutation& m : batch)
+            if (m.ok) chunk += to_string(m.seq) + ' ' + m.line + '\n';
+        if (!chunk.empty()) { log.write(chunk.data(), chunk.size()); log.flush(); }
+    }
+
+    void reply(vector<Mutation>& batch) {
+        if (respond) for (const Mutation& m : batch) respond(m.seq, m.ok, m.error);
+    }
+
+    void runStage(int i) {
+        SpscRing<Mutation>& in = *rings[i];
+        SpscRing<Mutation>* out = i + 1 < stageCount ? rings[i + 1].get() : nullptr;
+        vector<Mutation> batch;
+        Mutation m;
+        while (true) {
+            bool upstreamDone = stageDone[i].load(memory_order_acquire);
+            while (batch.size() < batchSize && in.pop(m)) batch.push_back(move(m));
+            if (batch.empty()) {
+                if (upstreamDone) break;
+                bells[i].wait([&] { return in.size() > 0 || stageDone[i].load(memory_order_acquire); });
+                continue;
+            }
+            switch (i) {
+                case 0: parse(batch); break;
+                case 1: validate(batch); break;
+                case 2: apply(batch); break;
+                case 3: writeLog(batch); break;
+                default: reply(batch); break;
+            }
+            if (out) {
+                for (Mutation& x : batch)
+                    while (!out->push(move(x))) { bells[i + 1].ring(); this_thread::yield(); }
+                bells[i + 1].ring();
+            }
+            batch.clear();
+        }
+        stageDone[i + 1].store(true, memory_order_release);
+        if (i + 1 < stageCount) bells[i + 1].ring();
+    }
+public:
+    MutationPipeline(Library& l, ostream& logStream, Responder r, size_t batch = 64, size_t ringSize = 4096)
+        : lib(l), log(logStream), respond(move(r)), batchSize(max<size_t>(1, batch)) {
+        for (int i = 0; i < stageCount; ++i) rings.push_back(make_unique<SpscRing<Mutation>>(ringSize));
+        for (auto& d : stageDone) d = false;
+        for (int i = 0; i < stageCount; ++i) workers.emplace_back([this, i] { runStage(i); });
+    }
+    ~MutationPipeline() { close(); }
+
+    // Подавати команди може лише один потік
+    uint64_t submit(string line) {
+        Mutation m;
+        m.seq = nextSeq++;
+        m.line = move(line);
+        while (!rings[0]->push(move(m))) { bells[0].ring(); this_thread::yield(); }
+        bells[0].ring();
+        return nextSeq - 1;
+    }
+
+    // Дочікується обробки всіх поданих команд і зупиняє стадії
+    void close() {
+        stageDone[0] = true;
+        bells[0].ring();
+        for (auto& w : workers) if (w.joinable()) w.join();
+    }
+};
+
+// ===== Режим "потік на ядро": кожен шард володіє своїми книгами й користувачами =====
+// Шарди не мають спільного стану; операції між шардами йдуть повідомленнями через SPSC-кільця.
+// Клієнтські потоки (індекси 0..clients-1) теж мають окремі кільця до кожного шарда
+class ShardedLibrary {
+public:
+    struct Ticket {
+        atomic<int> state{0};       // 0 — в обробці, 1 — успіх, 2 — відмова
+    };
+private:
+    enum class Op : uint8_t { AddBook, AddUser, Borrow, Return, ReserveBook, ReleaseBook, BookReply };
+    struct Message {
+        Op op = Op::BookReply;
+        int userId = 0, bookId = 0;
+        bool ok = false;
+        shared_ptr<Ticket> ticket;   // клієнт може відпустити свій квиток раніше за відповідь
+        unique_ptr<Book> book;
+        unique_ptr<User> user;
+    };
+    struct Shard {
+        unordered_map<int, unique_ptr<Book>> books;
+        unordered_map<int, int> holders;               // книга → хто її взяв, як Library::borrowers
+        unordered_map<int, unique_ptr<User>> users;
+        vector<unique_ptr<SpscRing<Message>>> inbox;   // по одному кільцю від кожного відправника
+        vector<deque<Message>> backlog;                // повідомлення, що не влізли в кільце адресата
+        // Простій: робітник спить на змінній умови, відправник будить його після запису в кільце.
+        // signals = (лічильник відправок << 1) | робітник засинає
+        mutex parkMutex;
+        condition_variable parked;
+        atomic<uint64_t> signals{0};
+        thread worker;
+    };
+    vector<unique_ptr<Shard>> shards;
+    static const unsigned spinYields = 256;   // поступок процесором перед сном
+    size_t clients;
+    atomic<bool> running{true};
+    atomic<int> nextUserId{1};
+
+    size_t shardOf(int key) const { return (unsigned)key % shards.size(); }
+    size_t senderIndex(size_t shard) const { return clients + shard; }
+
+    static void finish(const shared_ptr<Ticket>& t, bool ok) { if (t) t->state.store(ok ? 1 : 2, memory_order_release); }
+
+    // Обидві сторони роблять RMW над signals, тож вони впорядковані: або робітник побачить
+    // повідомлення (чи новий лічильник), або відправник побачить біт сну й розбудить його
+    void wake(size_t to) {
+        Shard& target = *shards[to];
+        if (!(target.signals.fetch_add(2, memory_order_acq_rel) & 1)) return;
+        lock_guard<mutex> lock(target.parkMutex);
+        target.parked.notify_one();
+    }
+
+    static bool hasInput(const Shard& s) {
+        for (const auto& ring : s.inbox)
+            if (ring->size()) return true;
+        return false;
+    }
+
+    void park(Shard& self) {
+        uint64_t seen = self.signals.fetch_or(1, memory_order_acq_rel) >> 1;
+        {
+            unique_lock<mutex> lock(self.parkMutex);
+            self.parked.wait(lock, [&] {
+                return !running.load() || hasInput(self) || self.signals.load(memory_order_acquire) >> 1 != seen;
+            });
+        }
+        self.signals.fetch_and(~(uint64_t)1, memory_order_relaxed);
+    }
+
+    // Відправка від шарда: при повному кільці повідомлення чекає в backlog, шард не блокується
+    void send(size_t from, size_t to, Message m) {
+        Shard& self = *shards[from];
+        if (!self.backlog[to].empty() || !shards[to]->inbox[senderIndex(from)]->push(move(m)))
+            self.backlog[to].push_back(move(m));
+        else wake(to);
+    }
+    // Повертає true, якщо щось лишилося невідправленим
+    bool flushBacklog(size_t from) {
+        Shard& self = *shards[from];
+        bool pending = false;
+        for (size_t to = 0; to < shards.size(); ++to) {
+            auto& q = self.backlog[to];
+            bool moved = false;
+            while (!q.empty() && shards[to]->inbox[senderIndex(from)]->push(move(q.front()))) { q.pop_front(); moved = true; }
+            if (moved) wake(to);
+            pending = pending || !q.empty();
+        }
+        return pending;
+    }
+
+    void handle(size_t idx, Message& m) {
+        Shard& self = *shards[idx];
+        switch (m.op) {
+            case Op::AddBook: { int id = m.book->getId(); self.books[id] = move(m.book); finish(m.ticket, true); break; }
+            case Op::AddUser: self.users[m.userId] = move(m.user); finish(m.ticket, true); break;
+            case Op::Borrow: {
+                auto it = self.users.find(m.userId);
+                if (it == self.users.end() || !it->second->canBorrow()) { finish(m.ticket, false); break; }
+                it->second->borrowBook();   // місце під позику резервується до відповіді шарда книги
+                m.op = Op::ReserveBook;
+                send(idx, shardOf(m.bookId), move(m));
+                break;
+            }
+            case Op::Return:
+                if (!self.users.count(m.userId)) { finish(m.ticket, false); break; }
+                m.op = Op::ReleaseBook;
+                send(idx, shardOf(m.bookId), move(m));
+                break;
+            case Op::ReserveBook:
+            case Op::ReleaseBook: {
+                auto it = self.books.find(m.bookId);
+                if (it == self.books.end()) m.ok = false;
+                else if (m.op == Op::ReserveBook) {
+                    m.ok = it->second->borrow();
+                    if (m.ok) self.holders[m.bookId] = m.userId;
+                } else {
+                    // Повернути книгу може лише той, хто її взяв
+                    auto holder = self.holders.find(m.bookId);
+                    m.ok = holder != self.holders.end() && holder->second == m.userId;
+                    if (m.ok) {
+                        self.holders.erase(holder);
+                        it->second->returnBook();
+                    }
+                }
+                Op request = m.op;
+                m.op = Op::BookReply;
+                m.bookId = request == Op::ReserveBook ? m.bookId : -m.bookId - 1;   // знак кодує тип запиту
+                send(idx, shardOf(m.userId), move(m));
+                break;
+            }
+            case Op::BookReply: {
+                User* u = self.users[m.userId].get();
+                if (m.bookId >= 0 ? !m.ok : m.ok) u->returnBook();
+                finish(m.ticket, m.ok);
+                break;
+            }
+        }
+    }
+
+    void run(size_t idx) {
+#ifdef __linux__
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(idx % max(1u, thread::hardware_concurrency()), &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof cpus, &cpus);
+#endif
+        Shard& self = *shards[idx];
+        Message m;
+        unsigned idle = 0;
+        while (running.load(memory_order_relaxed)) {
+            bool worked = false;
+            for (auto& ring : self.inbox)
+                for (int n = 0; n < 64 && ring->pop(m); ++n) { handle(idx, m); worked = true; }
+            bool pending = flushBacklog(idx);
+            if (worked) idle = 0;
+            else if (++idle > 64) {
+                // Спершу коротко поступаємося процесором, далі спимо до сигналу.
+                // З невідправленим backlog спати не можна: адресат звільнить місце без сигналу
+                if (pending || idle < 64 + spinYields) this_thread::yield();
+                else { park(self); idle = 0; }
+            }
+        }
+    }
+
+    shared_ptr<Ticket> submit(size_t client, size_t shard, Message m) {
+        auto t = make_shared<Ticket>();
+        m.ticket = t;
+        while (!shards[shard]->inbox[client]->push(move(m))) this_thread::yield();
+        wake(shard);
+        return t;
+    }
+public:
+    ShardedLibrary(size_t shardCount, size_t clientCount, size_t ringSize = 1024) : clients(max<size_t>(1, clientCount)) {
+        shardCount = max<size_t>(1, shardCount);
+        for (size_t i = 0; i < shardCount; ++i) {
+            shards.push_back(make_unique<Shard>());
+            for (size_t j = 0; j < clients + shardCount; ++j)
+                shards[i]->inbox.push_back(make_unique<SpscRing<Message>>(ringSize));
+            shards[i]->backlog = vector<deque<Message>>(shardCount);
+        }
+        for (size_t i = 0; i < shardCount; ++i) shards[i]->worker = thread([this, i] { run(i); });
+    }
+    ~ShardedLibrary() {
+        running = false;
+        for (auto& s : shards) {
+            lock_guard<mutex> lock(s->parkMutex);
+            s->parked.notify_all();
+        }
+        for (auto& s : shards) s->worker.join();
+    }
+
+    // Асинхронні операції; client — індекс клієнтського потоку, кожен потік має свій
+    shared_ptr<Ticket> addBook(size_t client, const Book& b) {
+        Message m;
+        m.op = Op::AddBook;
+        m.book = b.clone();
+        return submit(client, shardOf(b.getId()), move(m));
+    }
+    int addStudent(size_t client, string n, string f, int y, shared_ptr<Ticket>* ticket = nullptr) {
+        Message m;
+        m.op = Op::AddUser;
+        m.userId = nextUserId++;
+        m.user = make_unique<Student>(move(n), move(f), y);
+        int id = m.userId;
+        auto t = submit(client, shardOf(id), move(m));
+        if (ticket) *ticket = t;
+        return id;
+    }
+    shared_ptr<Ticket> borrow(size_t client, int userId, int bookId) {
+        Message m;
+        m.op = Op::Borrow;
+        m.userId = userId;
+        m.bookId = bookId;
+        return submit(client, shardOf(userId), move(m));
+    }
+    shared_ptr<Ticket> giveBack(size_t client, int userId, int bookId) {
+        Message m;
+        m.op = Op::Return;
+        m.userId = userId;
+        m.bookId = bookId;
+        return submit(client, shardOf(userId), move(m));
+    }
+
+    static bool wait(const Ticket& t) {
+        int s;
+        while ((s = t.state.load(memory_order_acquire)) == 0) this_thread::yield();
+        return s == 1;
+    }
+};
+
+// ===== Репліки для читання з причинними токенами =====
+// Лідер нумерує мутації (LSN) і повертає токен; послідовники застосовують журнал
+// асинхронно. Читання з токеном іде на послідовника, який уже застосував цей LSN,
+// трохи чекає на відсталого або перенаправляється на лідера
+struct ReadToken {
+    uint64_t lsn = 0;
+    void advance(uint64_t to) { lsn = max(lsn, to); }
+};
+
+class ReplicatedLibrary {
+    enum class Kind : uint8_t { AddBook, AddStudent, AddLibrarian, Checkout, Checkin };
+    struct Entry {
+        Kind kind;
+        string user, extra, book;   // user/extra — дані нового користувача; book — серіалізований запис для AddBook
+        int number;
+        UserRow row;                // рядок користувача: однаковий на всіх репліках, бо журнал спільний
+        time_t at;                  // час мутації на лідері, щоб історія "на момент" збігалася
+    };
+    // Читання беруть спільне блокування й не чекають одне на одного; застосування журналу — виключне
+    struct Replica {
+        Library lib;
+        shared_timed_mutex mtx;
+        condition_variable_any caughtUp;
+        atomic<uint64_t> applied{0};
+        thread worker;
+    };
+
+    Replica leader;
+    vector<unique_ptr<Replica>> followers;
+    mutex logMutex;
+    condition_variable logCv;
+    // Лише записи, які ще не застосував хоч один послідовник: log[i] має LSN logBase + i + 1
+    deque<Entry> log;
+    uint64_t logBase = 0;
+    bool stopping = false;
+    chrono::microseconds replicationDelay, maxWait;
+    atomic<size_t> nextFollower{0};
+    atomic<uint64_t> followerReads{0}, waitedReads{0}, leaderReads{0};
+
+    // Для нових користувачів записує в e.row отриманий рядок
+    static bool apply(Library& lib, Entry& e) {
+        switch (e.kind) {
+            case Kind::AddBook: {
+                istringstream in(e.book);
+                unique_ptr<Book> b = Book::deserialize(in);
+                if (!b) return false;
+                lib.addBook(*b);
+                return true;
+            }
+            case Kind::AddStudent: e.row = lib.addStudent(e.user, e.extra, e.number); return true;
+            case Kind::AddLibrarian: e.row = lib.addLibrarian(e.user, e.extra); return true;
+            case Kind::Checkout: return lib.checkout(e.row, e.number, e.at);
+            case Kind::Checkin: return lib.checkin(e.row, e.number, e.at);
+        }
+        return false;
+    }
+
+    // Застосовує на лідері й, якщо вдалося, дописує до журналу під тим самим блокуванням,
+    // щоб порядок журналу збігався з порядком на лідері
+    bool write(Entry& e, ReadToken& token) {
+        lock_guard<shared_timed_mutex> lock(leader.mtx);
+        e.at = time(nullptr);
+        if (!apply(leader.lib, e)) return false;
+        uint64_t lsn;
+        {
+            lock_guard<mutex> logLock(logMutex);
+            if (followers.empty()) logBase++;   // журнал нікому читати
+            else log.push_back(move(e));
+            lsn = logBase + log.size();
+        }
+        leader.applied = lsn;
+        logCv.notify_all();
+        token.advance(lsn);
+        return true;
+    }
+
+    void replicate(Replica& r) {
+        uint64_t next = 0;
+        while (true) {
+            vector<Entry> batch;
+            {
+                unique_lock<mutex> lock(logMutex);
+                logCv.wait(lock, [&] { return stopping || logBase + log.size() > next; });
+                if (stopping) return;
+                batch.assign(log.begin() + (ptrdiff_t)(next - logBase), log.end());
+            }
+            if (replicationDelay.count() > 0) this_thread::sleep_for(replicationDelay);   // мережа й диск
+            {
+                lock_guard<shared_timed_mutex> lock(r.mtx);
+                for (Entry& e : batch) apply(r.lib, e);
+                next += batch.size();
+                r.applied = next;
+            }
+            r.caughtUp.notify_all();
+            truncateLog();
+        }
+    }
+
+    // Відкидає записи, які вже застосували всі послідовники
+    void truncateLog() {
+        lock_guard<mutex> lock(logMutex);
+        uint64_t done = UINT64_MAX;
+        for (auto& f : followers) done = min(done, f->applied.load());
+        while (logBase < done && !log.empty()) {
+            log.pop_front();
+            logBase++;
+        }
+    }
+public:
+    ReplicatedLibrary(size_t followerCount, chrono::microseconds delay = chrono::milliseconds(5),
+                      chrono::microseconds wait = chrono::milliseconds(2))
+        : replicationDelay(delay), maxWait(wait) {
+        for (size_t i = 0; i < followerCount; ++i) followers.push_back(make_unique<Replica>());
+        for (auto& f : followers) {
+            Replica* r = f.get();
+            r->worker = thread([this, r] { replicate(*r); });
+        }
+    }
+    ~ReplicatedLibrary() {
+        {
+            lock_guard<mutex> lock(logMutex);
+            stopping = true;
+        }
+        logCv.notify_all();
+        for (auto& f : followers) f->worker.join();
+    }
+
+    // Мутації; при успіху токен сесії просувається до LSN запису
+    bool addBook(const Book& b, ReadToken& token) {
+        ostringstream out;
+        b.serialize(out);
+        Entry e{Kind::AddBook, "", "", out.str(), 0, noUser, 0};
+        return write(e, token);
+    }
+    // Повертають рядок нового користувача, дійсний на всіх репліках
+    UserRow addStudent(string n, string f, int y, ReadToken& token) {
+        Entry e{Kind::AddStudent, move(n), move(f), "", y, noUser, 0};
+        return write(e, token) ? e.row : noUser;
+    }
+    UserRow addLibrarian(string n, string id, ReadToken& token) {
+        Entry e{Kind::AddLibrarian, move(n), move(id), "", 0, noUser, 0};
+        return write(e, token) ? e.row : noUser;
+    }
+    bool checkout(UserRow user, int bookId, ReadToken& token) {
+        Entry e{Kind::Checkout, "", "", "", bookId, user, 0};
+        return write(e, token);
+    }
+    bool checkin(UserRow user, int bookId, ReadToken& token) {
+        Entry e{Kind::Checkin, "", "", "", bookId, user, 0};
+        return write(e, token);
+    }
+
+    // Читання, що бачить усі мутації до токена включно. f отримує const Library& під спільним
+    // блокуванням: паралельні читання не серіалізуються, застосування чекає лише на поточні
+    template<typename F>
+    auto read(const ReadToken& token, F f) -> decltype(f(declval<const Library&>())) {
+        if (!followers.empty()) {
+            Replica& r = *followers[nextFollower++ % followers.size()];
+            shared_lock<shared_timed_mutex> lock(r.mtx);
+            if (r.applied >= token.lsn) {
+                followerReads++;
+                return f(r.lib);
+            }
+            if (r.caughtUp.wait_for(lock, maxWait, [&] { return r.applied >= token.lsn; })) {
+                waitedReads++;
+                followerReads++;
+                return f(r.lib);
+            }
+        }
+        shared_lock<shared_timed_mutex> lock(leader.mtx);
+        leaderReads++;
+        return f(leader.lib);
+    }
+
+    uint64_t lastLsn() const { return leader.applied.load(); }
+    uint64_t followerLag(size_t i) const { return lastLsn() - followers[i]->applied.load(); }
+    size_t followerCount() const { return followers.size(); }
+    uint64_t readsOnFollowers() const { return followerReads.load(); }
+    uint64_t readsAfterWait() const { return waitedReads.load(); }
+    uint64_t readsOnLeader() const { return leaderReads.load(); }
+    size_t logEntries() { lock_guard<mutex> lock(logMutex); return log.size(); }
+};
+
+// ===== HTTP-ендпоінт /metrics =====
+// Окремий потік приймає з'єднання на 127.0.0.1 і віддає Metrics::render()
+class MetricsServer {
+    atomic<bool> running{false};
+    thread worker;
+    int listenFd = -1;
+
+    void serve() {
+#if defined(__unix__) || defined(__APPLE__)
+        while (running.load()) {
+            pollfd pfd{listenFd, POLLIN, 0};
+            if (poll(&pfd, 1, 200) <= 0) continue;
+            int fd = accept(listenFd, nullptr, nullptr);
+            if (fd < 0) continue;
+            char request[1024];
+            ssize_t n = recv(fd, request, sizeof request - 1, 0);
+            string path = "/";
+            if (n > 0) {
+                request[n] = '\0';
+                istringstream line(request);
+                string method;
+                line >> method >> path;
+            }
+            string body = path == "/metrics" ? Metrics::instance().render() : "Not found\n";
+            string response = string(path == "/metrics" ? "HTTP/1.1 200 OK\r\n" : "HTTP/1.1 404 Not Found\r\n")
+                              + "Content-Type: text/plain; version=0.0.4\r\nContent-Length: " + to_string(body.size())
+                              + "\r\nConnection: close\r\n\r\n" + body;
+            for (size_t sent = 0; sent < response.size();) {
+                ssize_t w = send(fd, response.data() + sent, response.size() - sent, 0);
+                if (w <= 0) break;
+                sent += w;
+            }
+            close(fd);
+        }
+#endif
+    }
+public:
+    ~MetricsServer() { stop(); }
+
+    bool start(uint16_t port) {
+#if defined(__unix__) || defined(__APPLE__)
+        if (running) return true;
+        listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        if (listenFd < 0) return false;
+        int yes = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof yes);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::bind(listenFd, (sockaddr*)&addr, sizeof addr) < 0 || listen(listenFd, 16) < 0) {
+            close(listenFd);
+            listenFd = -1;
+            return false;
+        }
+        running = true;
+        worker = thread([this] { serve(); });
+        return true;
+#else
+        (void)port;
+        return false;
+#endif
+    }
+
+    void stop() {
+        if (!running) return;
+        running = false;
+        worker.join();
+#if defined(__unix__) || defined(__APPLE__)
+        close(listenFd);
+#endif
+        listenFd = -1;
+    }
+};
+
+// Показники пам'яті й розмірів каталогу; оцінки без блокування каталогу
+// Показники каталогу читають його лічильники; каталог має пережити повернену реєстрацію
+static GaugeRegistration registerCatalogGauges(const Catalog& catalog) {
+    const Catalog::Stats& st = catalog.stats();
+    Metrics& m = Metrics::instance();
+    GaugeRegistration reg(m.newGaugeGroup());
+    uint64_t g = reg.id();
+    m.addGauge(g, "library_books", "Books in the catalog by residency.", "tier=\"hot\"", [&st] { return (double)st.resident.load(); });
+    m.addGauge(g, "library_books", "Books in the catalog by residency.", "tier=\"cold\"", [&st] { return (double)st.cold.load(); });
+    m.addGauge(g, "library_index_entries", "Entries in ready catalog indexes.", "", [&st] { return (double)st.indexEntries.load(); });
+    m.addGauge(g, "library_memory_bytes", "Memory by component.", "component=\"books\"", [&st] { return (double)st.bookBytes.load(); });
+    m.addGauge(g, "library_memory_bytes", "Memory by component.", "component=\"slots\"", [&st] { return (double)st.slotBytes.load(); });
+    m.addGauge(g, "library_memory_bytes", "Memory by component.", "component=\"indexes\"", [&st] { return (double)st.indexBytes.load(); });
+    m.addGauge(g, "library_memory_bytes", "Memory by component.", "component=\"id_table\"", [&st] { return (double)st.idTableBytes.load(); });
+    return reg;
+}
+
+// ===== Планувальник фонового обслуговування з бюджетами CPU та вводу-виводу =====
+// Ущільнення, контрольні точки, побудова індексів і прогрів кешу виконуються
+// порціями в одному фоновому потоці. Кожна задача має пріоритет і бюджети у вигляді
+// відер токенів; коли затримка пошуку й видачі зростає, бюджети стискаються
+enum class MaintenancePriority : uint8_t { Critical, Normal, Idle };
+
+struct MaintenanceBudget {
+    double cpuShare = 0.25;               // частка одного ядра
+    uint64_t ioBytesPerSec = 64u << 20;
+};
+
+class MaintenanceScheduler {
+public:
+    // Крок виконує порцію роботи, додає прочитані/записані байти до ioBytes
+    // і повертає false, коли задача завершена
+    using Step = function<bool(uint64_t& ioBytes)>;
+
+    struct TaskStats {
+        string name;
+        MaintenancePriority priority;
+        uint64_t steps, cpuNs, ioBytes;
+        bool done;
+    };
+private:
+    struct Task {
+        string name;
+        MaintenancePriority priority;
+        MaintenanceBudget budget;
+        Step step;
+        double cpuTokensNs = 0, ioTokens = 0;   // можуть іти в мінус: борг сплачується очікуванням
+        uint64_t steps = 0, cpuNs = 0, ioBytes = 0;
+        bool done = false;
+    };
+    static constexpr double burstSec = 0.05;
+    static constexpr chrono::milliseconds controlInterval{20};
+
+    mutable mutex mtx;
+    condition_variable cv, idleCv;
+    vector<Task> tasks;
+    size_t cursor = 0;          // циклічний обхід у межах пріоритету
+    uint64_t submissions = 0;
+    bool stopping = false, running = false;
+    double latencyTargetNs;
+    double ewmaNs = 0;
+    double factor = 1.0;        // множник бюджетів для Normal/Idle
+    pair<uint64_t, uint64_t> lastTotals{0, 0};
+    chrono::steady_clock::time_point lastRefill, lastControl;
+    thread worker;
+
+    static const Operation foreground[3];
+
+    void observeLocked(double ns) {
+        ewmaNs = ewmaNs == 0 ? ns : 0.8 * ewmaNs + 0.2 * ns;
+    }
+
+    // Середня затримка фонових операцій з Metrics за останній інтервал
+    void sampleForeground() {
+        pair<uint64_t, uint64_t> now{0, 0};
+        for (Operation op : foreground) {
+            auto t = Metrics::instance().totals(op);
+            now.first += t.first;
+            now.second += t.second;
+        }
+        lock_guard<mutex> lock(mtx);
+        if (now.first > lastTotals.first)
+            observeLocked(double(now.second - lastTotals.second) / double(now.first - lastTotals.first));
+        else
+            ewmaNs *= 0.5;   // без фонового трафіку обмежувати нічого
+        lastTotals = now;
+    }
+
+    // AIMD: різке зменшення при перевищенні цілі, поступове відновлення
+    void adjustLocked() {
+        if (ewmaNs > latencyTargetNs) factor = max(0.05, factor * 0.5);
+        else factor = min(1.0, factor + 0.05);
+    }
+
+    double shareOf(const Task& t) const {
+        if (t.priority == MaintenancePriority::Critical) return 1.0;
+        if (t.priority == MaintenancePriority::Idle && ewmaNs > latencyTargetNs) return 0.0;
+        return factor;
+    }
+
+    void refillLocked(chrono::steady_clock::time_point now) {
+        double sec = chrono::duration<double>(now - lastRefill).count();
+        lastRefill = now;
+        for (Task& t : tasks) {
+            double k = shareOf(t);
+            t.cpuTokensNs = min(t.cpuTokensNs + sec * 1e9 * t.budget.cpuShare * k, burstSec * 1e9 * t.budget.cpuShare);
+            t.ioTokens = min(t.ioTokens + sec * t.budget.ioBytesPerSec * k, burstSec * t.budget.ioBytesPerSec);
+        }
+    }
+
+    // Найвищий пріоритет серед задач із додатними токенами; -1, якщо таких немає
+    int pickLocked() {
+        for (int prio = 0; prio <= (int)MaintenancePriority::Idle; ++prio)
+            for (size_t k = 0; k < tasks.size(); ++k) {
+                size_t i = (cursor + k) % tasks.size();
+                const Task& t = tasks[i];
+                if (!t.done && (int)t.priority == prio && t.cpuTokensNs > 0 && t.ioTokens > 0) {
+                    cursor = i + 1;
+                    return (int)i;
+                }
+            }
+        return -1;
+    }
+
+    bool pendingLocked() const {
+        return any_of(tasks.begin(), tasks.end(), [](const Task& t) { return !t.done; });
+    }
+
+    // Коли борг найближчої задачі покриється поповненням; не пізніше наступного кроку регулятора,
+    // бо він змінює швидкість поповнення
+    chrono::steady_clock::time_point nextRunnableLocked(chrono::steady_clock::time_point now) const {
+        auto wake = lastControl + controlInterval;
+        for (const Task& t : tasks) {
+            double k = shareOf(t), cpuRate = 1e9 * t.budget.cpuShare * k, ioRate = (double)t.budget.ioBytesPerSec * k;
+            if (t.done || cpuRate <= 0 || ioRate <= 0) continue;
+            double sec = max(max(0.0, -t.cpuTokensNs) / cpuRate, max(0.0, -t.ioTokens) / ioRate);
+            wake = min(wake, now + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(sec))
+                                 + chrono::microseconds(1));
+        }
+        return wake;
+    }
+
+    void run() {
+        unique_lock<mutex> lock(mtx);
+        while (true) {
+            cv.wait(lock, [this] { return stopping || pendingLocked(); });
+            if (stopping) return;
+            auto now = chrono::steady_clock::now();
+            if (now - lastControl >= controlInterval) {
+                lastControl = now;
+                lock.unlock();
+                sampleForeground();
+                lock.lock();
+                adjustLocked();
+            }
+            refillLocked(now);
+            int i = pickLocked();
+            if (i < 0) {
+                // Жодна задача не має токенів: спимо до поповнення, нова задача чи зупинка будять раніше
+                uint64_t seen = submissions;
+                cv.wait_until(lock, nextRunnableLocked(now), [&] { return stopping || submissions != seen; });
+                continue;
+            }
+            Step step = tasks[i].step;   // vector може перерозподілитися під час кроку
+            running = true;
+            lock.unlock();
+            uint64_t io = 0;
+            auto start = chrono::steady_clock::now();
+            bool more = step(io);
+            uint64_t spent = (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+            lock.lock();
+            running = false;
+            Task& t = tasks[i];
+            t.steps++;
+            t.cpuNs += spent;
+            t.ioBytes += io;
+            t.cpuTokensNs -= spent;
+            t.ioTokens -= io;
+            t.done = !more;
+            if (!pendingLocked()) idleCv.notify_all();
+        }
+    }
+public:
+    explicit MaintenanceScheduler(chrono::microseconds latencyTarget = chrono::milliseconds(1))
+        : latencyTargetNs(chrono::duration<double, nano>(latencyTarget).count()),
+          lastRefill(chrono::steady_clock::now()), lastControl(lastRefill) {
+        for (Operation op : foreground) {
+            auto t = Metrics::instance().totals(op);
+            lastTotals.first += t.first;
+            lastTotals.second += t.second;
+        }
+        worker = thread([this] { run(); });
+    }
+    ~MaintenanceScheduler() {
+        {
+            lock_guard<mutex> lock(mtx);
+            stopping = true;
+        }
+        cv.notify_one();
+        worker.join();
+    }
+
+    void submit(string name, MaintenancePriority priority, MaintenanceBudget budget, Step step) {
+        lock_guard<mutex> lock(mtx);
+        Task t;
+        t.name = move(name);
+        t.priority = priority;
+        t.budget = budget;
+        t.step = move(step);
+        tasks.push_back(move(t));
+        submissions++;
+        cv.notify_one();
+    }
+
+    // Додаткове джерело затримок для операцій поза ScopedTimer (наприклад, шардів)
+    void reportForegroundLatency(chrono::nanoseconds latency) {
+        lock_guard<mutex> lock(mtx);
+        observeLocked((double)latency.count());
+    }
+
+    void waitIdle() {
+        unique_lock<mutex> lock(mtx);
+        idleCv.wait(lock, [this] { return !pendingLocked() && !running; });
+    }
+
+    double throttleFactor() const { lock_guard<mutex> lock(mtx); return factor; }
+    double foregroundLatencyNs() const { lock_guard<mutex> lock(mtx); return ewmaNs; }
+
+    vector<TaskStats> stats() const {
+        lock_guard<mutex> lock(mtx);
+        vector<TaskStats> out;
+        for (const Task& t : tasks) out.push_back(TaskStats{t.name, t.priority, t.steps, t.cpuNs, t.ioBytes, t.done});
+        return out;
+    }
+};
+constexpr double MaintenanceScheduler::burstSec;
+constexpr chrono::milliseconds MaintenanceScheduler::controlInterval;
+const Operation MaintenanceScheduler::foreground[3] = {Operation::Search, Operation::Borrow, Operation::Return};
+
+// ===== Вбудований семплювальний профайлер =====
+// SIGPROF за таймером процесорного часу; обробник без виділень пам'яті й блокувань пише стек
+// у буфер свого потоку. Символи розв'язуються лише при експорті у folded-формат
+class SamplingProfiler {
+    static const int maxDepth = 32;
+    struct Sample {
+        int depth;
+        void* pcs[maxDepth];
+    };
+    struct ThreadBuffer {
+        atomic<long> owner{0};      // tid потоку, що зайняв буфер
+        atomic<size_t> count{0};
+        vector<Sample> samples;
+    };
+    vector<ThreadBuffer> buffers;
+    atomic<size_t> dropped{0};
+    bool running = false;
+    static atomic<SamplingProfiler*> active;
+
+#ifdef LIBRARY_PROFILER
+    struct sigaction previous{};
+
+    static void onSignal(int) {
+        SamplingProfiler* self = active.load(memory_order_acquire);
+        if (!self) return;
+        int savedErrno = errno;
+        long tid = syscall(SYS_gettid);
+        size_t n = self->buffers.size();
+        for (size_t i = 0; i < n; ++i) {
+            ThreadBuffer& b = self->buffers[(size_t)(tid + i) % n];
+            long owner = b.owner.load(memory_order_relaxed);
+            if (owner != tid && !(owner == 0 && b.owner.compare_exchange_strong(owner, tid))) continue;
+            size_t c = b.count.load(memory_order_relaxed);
+            if (c < b.samples.size()) {
+                Sample& smp = b.samples[c];
+                smp.depth = backtrace(smp.pcs, maxDepth);
+                b.count.store(c + 1, memory_order_release);
+            } else self->dropped++;
+            errno = savedErrno;
+            return;
+        }
+        self->dropped++;
+        errno = savedErrno;
+    }
+
+    static string symbolize(void* pc) {
+        Dl_info info;
+        if (!dladdr(pc, &info) || !info.dli_fname) return "[unknown]";
+        if (info.dli_sname) {
+            int status = 0;
+            char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+            string name = status == 0 ? demangled : info.dli_sname;
+            free(demangled);
+            return name;
+        }
+        // Без символу — модуль і зсув для офлайн-розв'язання через addr2line
+        ostringstream os;
+        string module = info.dli_fname;
+        os << module.substr(module.rfind('/') + 1) << "+0x" << hex << ((char*)pc - (char*)info.dli_fbase);
+        return os.str();
+    }
+#endif
+public:
+    SamplingProfiler(size_t maxThreads = 64, size_t samplesPerThread = 2048) : buffers(maxThreads) {
+        for (auto& b : buffers) b.samples.resize(samplesPerThread);
+    }
+    ~SamplingProfiler() { stop(); }
+
+    bool start(int hz = 99) {
+#ifdef LIBRARY_PROFILER
+        if (running) return true;
+        SamplingProfiler* expected = nullptr;
+        if (!active.compare_exchange_strong(expected, this)) return false;
+        void* warmup[1];
+        backtrace(warmup, 1);   // перше звернення підвантажує libgcc — не можна робити в обробнику
+        for (auto& b : buffers) { b.owner = 0; b.count = 0; }
+        dropped = 0;
+        struct sigaction sa{};
+        sa.sa_handler = onSignal;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGPROF, &sa, &previous);
+        itimerval timer{};
+        timer.it_interval.tv_usec = 1000000 / max(1, hz);
+        timer.it_value = timer.it_interval;
+        setitimer(ITIMER_PROF, &timer, nullptr);
+        running = true;
+        return true;
+#else
+        (void)hz;
+        return false;
+#endif
+    }
+
+    void stop() {
+#ifdef LIBRARY_PROFILER
+        if (!running) return;
+        itimerval off{};
+        setitimer(ITIMER_PROF, &off, nullptr);
+        sigaction(SIGPROF, &previous, nullptr);
+        active = nullptr;
+        running = false;
+#endif
+    }
+
+    bool isRunning() const { return running; }
+    size_t droppedSamples() const { return dropped.load(); }
+
+    // Рядки "корінь;...;лист кількість" для flamegraph.pl / speedscope
+    void writeFolded(ostream& out) const {
+#ifdef LIBRARY_PROFILER
+        map<void*, string> names;
+        map<string, size_t> stacks;
+        const int skip = 2;   // обробник сигналу і трамплін ядра
+        for (const auto& b : buffers) {
+            size_t n = b.count.load(memory_order_acquire);
+            for (size_t i = 0; i < n; ++i) {
+                const Sample& smp = b.samples[i];
+                string stack;
+                for (int d = smp.depth - 1; d >= skip; --d) {
+                    auto it = names.find(smp.pcs[d]);
+                    if (it == names.end()) it = names.emplace(smp.pcs[d], symbolize(smp.pcs[d])).first;
+                    if (!stack.empty()) stack += ';';
+                    stack += it->second;
+                }
+                if (!stack.empty()) stacks[stack]++;
+            }
+        }
+        for (const auto& st : stacks) out << st.first << ' ' << st.second << '\n';
+#else
+        (void)out;
+#endif
+    }
+};
+atomic<SamplingProfiler*> SamplingProfiler::active{nullptr};
+
+// Тести й бенчмарки підключають цей файл з LIBRARY_NO_MAIN
+#ifndef LIBRARY_NO_MAIN
+void printMenu() {
+    cout << "\n=== Menu ===\n";
+    cout << "1. Add book\n2. List catalog\n3. Add student\n4. Add librarian\n5. List users\n6. Move cold books to disk\n"
+         << "7. Borrow book\n8. Return book\n9. Availability on date\n10. Search by title\n"
+         << "11. Start/stop profiler\n12. Simulate a semester\n0. Exit\n";
+}
+
+int main() {
+    AuditLog audit;
+    Library lib;
+    lib.setAudit(&audit);
+    GaugeRegistration gauges = registerCatalogGauges(lib.getCatalog());
+    MetricsServer metrics;
+    metrics.start(9464);
+    SamplingProfiler profiler;
+    SearchService search(lib.getCatalog());
+
+    lib.addBook(PrintedBook(lib.newBookId(),"Book1",Author("Author1"),2020,"History",200));
+    lib.addBook(EBook(lib.newBookId(),"Book2",Author("Author2"),2021,"Poetry",2.5));
+    lib.addBook(AudioBook(lib.newBookId(),"Book3",Author("Author3"),2019,"Drama",3.0));
+    lib.getCatalog().setIndexBudget(64 << 20);
+    lib.getCatalog().startWarming({IndexField::Title, IndexField::Author, IndexField::Genre});
+
+    int choice;
+    while (true) {
+        printMenu();
+        cout << "Choice: ";
+        if (!(cin >> choice)) { cin.clear(); cin.ignore(1000,'\n'); continue; }
+        cin.ignore();
+        if (choice==0) break;
+
+        if (choice==1) {
+            int type; cout << "Type (1-Printed,2-EBook,3-Audio): "; cin >> type; cin.ignore();
+            string title, author, genre; int year;
+            cout << "Title: "; getline(cin,title);
+            cout << "Author: "; getline(cin,author);
+            cout << "Year: "; cin >> year; cin.ignore();
+            cout << "Genre: "; getline(cin,genre);
+            int id = lib.newBookId();
+            if (type==1) { int pages; cout << "Pages: "; cin >> pages; cin.ignore(); lib.addBook(PrintedBook(id,title,Author(author),year,genre,pages)); }
+            else if (type==2) { double size; cout << "Size MB: "; cin >> size; cin.ignore(); lib.addBook(EBook(id,title,Author(author),year,genre,size)); }
+            else { double dur; cout << "Duration hours: "; cin >> dur; cin.ignore(); lib.addBook(AudioBook(id,title,Author(author),year,genre,dur)); }
+        }
+        else if (choice==2) {
+            int order; cout << "Sort (0-none,1-title,2-author): "; cin >> order; cin.ignore();
+            lib.getCatalog().listAll(order==1 ? SortOrder::Title : order==2 ? SortOrder::Author : SortOrder::None);
+        }
+        else if (choice==3) {
+            string n,f; int y;
+            cout << "Name: "; getline(cin,n);
+            cout << "Faculty: "; getline(cin,f);
+            cout << "Year: "; cin >> y; cin.ignore();
+            lib.addStudent(n,f,y);
+        }
+        else if (choice==4) {
+            string n,id;
+            cout << "Name: "; getline(cin,n);
+            cout << "Employee ID: "; getline(cin,id);
+            lib.addLibrarian(n,id);
+        }
+        else if (choice==5) { lib.listUsers(); }
+        else if (choice==6) {
+            size_t moved = lib.getCatalog().tierCold("cold_books.seg", 1);
+            lib.getCatalog().reclaim();   // меню не тримає покажчиків на книги між командами
+            cout << "Moved " << moved << " books to disk, " << lib.getCatalog().coldCount() << " cold in total\n";
+        }
+        else if (choice==7 || choice==8) {
+            string n; int id;
+            cout << "User name: "; getline(cin,n);
+            cout << "Book ID: "; cin >> id; cin.ignore();
+            UserRow u = lib.findUser(n);
+            bool ok = choice==7 ? lib.checkout(u,id) : lib.checkin(u,id);
+            cout << (ok ? "Done\n" : "Not possible\n");
+        }
+        else if (choice==9) {
+            int id; tm date{};
+            cout << "Book ID: "; cin >> id; cin.ignore();
+            cout << "Date (YYYY-MM-DD): "; cin >> get_time(&date, "%Y-%m-%d"); cin.ignore();
+            if (cin.fail()) { cin.clear(); cin.ignore(1000,'\n'); continue; }
+            date.tm_hour = 23; date.tm_min = 59; date.tm_sec = 59;
+            cout << (lib.wasAvailable(id, mktime(&date)) ? "Available\n" : "Borrowed\n");
+        }
+        else if (choice==10) {
+            string t;
+            cout << "Title: "; getline(cin,t);
+            for (int id : *search.find(IndexField::Title, t))
+                if (Book* b = lib.getCatalog().findById(id)) b->printInfo();
+        }
+        else if (choice==11) {
+            if (!profiler.isRunning()) { cout << (profiler.start() ? "Profiler started\n" : "Profiler unavailable\n"); continue; }
+            profiler.stop();
+            ofstream out("profile.folded");
+            profiler.writeFolded(out);
+            cout << "Profile written to profile.folded\n";
+        }
+        else if (choice==12) {
+            SimulationConfig cfg;
+            long long students;
+            cout << "Seed: "; cin >> cfg.seed;
+            cout << "Students: ";
+            if (!(cin >> students)) { cin.clear(); students = 0; }
+            cin.ignore(1000,'\n');
+            if (students <= 0) { cout << "Number of students must be positive\n"; continue; }
+            cfg.students = (size_t)students;
+            LibrarySimulator(cfg).run().print(cout);
         }
-        else if (choice==5) { lib.listUsers(); }
     }
 
     cout << "Exiting...\n";
     return 0;
 }
+#endif
@@ -0,0 +1,1006 @@
+// Тести бібліотеки: main.cpp підключається як одна одиниця трансляції без своєї main().
+// Запуск: library_tests [назва тесту]
+#include "../main.cpp"
+#include <map>
+#include <random>
+
+namespace {
+
+struct TestCase {
+    const char* name;
+    void (*run)();
+};
+vector<TestCase>& registry() { static vector<TestCase> tests; return tests; }
+struct Registration {
+    Registration(const char* name, void (*run)()) { registry().push_back(TestCase{name, run}); }
+};
+int failures = 0;
+
+#define TEST(name) \
+    static void name(); \
+    static Registration name##Registration(#name, name); \
+    static void name()
+#define CHECK(cond) \
+    do { if (!(cond)) { cerr << __FILE__ << ':' << __LINE__ << ": CHECK(" #cond ") failed\n"; ++failures; } } while (0)
+
+// Невеликий каталог з усіма підтипами, жанрами й роками
+void fillCatalog(Catalog& c, int n, int firstId = 1) {
+    for (int i = 0; i < n; ++i) {
+        int id = firstId + i;
+        string title = "Title " + to_string(i % 97), author = "Author " + to_string(i % 13);
+        int year = 1950 + i % 70;
+        const char* genre = fixedGenres[i % fixedGenreCount];
+        if (i % 3 == 0) c.addBook(PrintedBook(id, title, Author(author), year, genre, 50 + i % 900));
+        else if (i % 3 == 1) c.addBook(EBook(id, title, Author(author), year, genre, 0.5 + i % 40));
+        else c.addBook(AudioBook(id, title, Author(author), year, genre, 1.0 + i % 25));
+    }
+}
+
+template<typename T>
+vector<int> idsOf(const vector<T*>& books) {
+    vector<int> ids;
+    for (T* b : books) ids.push_back(b->getId());
+    sort(ids.begin(), ids.end());
+    return ids;
+}
+
+// ===== user-101: холодні записи повертаються з диска без втрат =====
+TEST(tieringFaultsColdBooksBackIn) {
+    Catalog c;
+    fillCatalog(c, 300);
+    for (int id = 1; id <= 30; ++id) c.findById(id);
+    size_t moved = c.tierCold("tests_tiering.seg", 1);
+    CHECK(moved == 270);
+    CHECK(c.coldCount() == 270);
+    Book* b = c.findById(200);
+    CHECK(b && b->getId() == 200 && b->getTitle() == "Title " + to_string(199 % 97));
+    CHECK(c.coldCount() == 269);
+    CHECK(idsOf(c.search([](const Book& x) { return x.getYear() == 1960; })).size() == 300 / 70 + (10 < 300 % 70));
+    remove("tests_tiering.seg");
+}
+
+// Покажчик, отриманий до винесення книги на диск, лишається дійсним до reclaim()
+TEST(tieringKeepsHandedOutBooksAlive) {
+    Catalog c;
+    fillCatalog(c, 100);
+    Book* b = c.findById(50);
+    c.tierCold("tests_tiering_alive.seg", 5);
+    CHECK(b->getId() == 50 && b->getTitle() == "Title 49");
+    CHECK(c.reclaim() == 100);
+    CHECK(c.findById(50)->getTitle() == "Title 49");
+
+    Library lib;
+    for (int id = 1; id <= 200; ++id) lib.addBook(PrintedBook(id, "B", Author("a"), 2000, "Drama", 1));
+    UserRow librarian = lib.addLibrarian("l", "E");
+    atomic<bool> stop{false};
+    thread tiering([&] { while (!stop) lib.getCatalog().tierCold("tests_tiering_library.seg", 1); });
+    int loans = 0;
+    for (int round = 0; round < 20; ++round)
+        for (int id = 1; id <= 200; ++id) loans += lib.checkout(librarian, id) && lib.checkin(librarian, id);
+    stop = true;
+    tiering.join();
+    CHECK(loans == 4000);
+    size_t available = 0;
+    lib.getCatalog().forEach([&](const Book& x) { available += x.isAvailable(); });
+    CHECK(available == 200);
+    remove("tests_tiering_alive.seg");
+    remove("tests_tiering_library.seg");
+}
+
+// Повторні цикли "на диск — назад у пам'ять" не роздувають сегмент
+TEST(tieringSegmentStaysBounded) {
+    Catalog c;
+    fillCatalog(c, 500);
+    c.tierCold("tests_tiering_cycles.seg", 1);
+    uint64_t oneCycle = c.segmentBytes();
+    for (int cycle = 0; cycle < 10; ++cycle) {
+        for (int id = 1; id <= 500; ++id) c.findById(id);
+        c.tierCold("tests_tiering_cycles.seg", 100);
+        c.reclaim();
+    }
+    CHECK(c.coldCount() == 500);
+    CHECK(c.segmentBytes() <= 2 * oneCycle);
+    for (int id = 1; id <= 500; ++id) CHECK(c.findById(id)->getId() == id);
+    remove("tests_tiering_cycles.seg");
+}
+
+// Запис через покажчик, виданий до винесення, відхиляється, а не губиться
+TEST(tieringDetachesHandedOutBooks) {
+    Catalog c;
+    fillCatalog(c, 10);
+    Book* stale = c.findById(1);
+    c.tierCold("tests_tiering_detach.seg", 5);
+    CHECK(stale->isDetached());
+    CHECK(!stale->borrow());
+    Book* live = c.findById(1);
+    CHECK(live != stale && !live->isDetached());
+    CHECK(live->borrow());
+    CHECK(!c.findById(1)->isAvailable());
+    c.tierCold("tests_tiering_detach.seg", 0);      // наступний прохід звільняє відкріплені копії
+    CHECK(c.reclaim() == 0);
+    remove("tests_tiering_detach.seg");
+}
+
+// Ущільнення не лишає тимчасових файлів ні після успіху, ні після помилки читання
+TEST(tieringCompactionCleansUpTempFiles) {
+    const string path = "tests_tiering_compact.seg";
+    auto exists = [](const string& p) { return (bool)ifstream(p); };
+    Catalog c;
+    fillCatalog(c, 200);
+    c.tierCold(path, 1);
+    for (int id = 1; id <= 150; ++id) c.findById(id);
+    c.tierCold(path, 0);
+    CHECK(!exists(path + ".tmp") && !exists(path + ".old"));
+    for (int id = 151; id <= 200; ++id) CHECK(c.findById(id)->getId() == id);
+
+    c.tierCold(path, 100);
+    for (int id = 1; id <= 150; ++id) c.findById(id);
+    { ofstream damage(path, ios::trunc); }            // сегмент пошкоджено ззовні
+    c.tierCold(path, 0);
+    CHECK(!exists(path + ".tmp") && !exists(path + ".old"));
+    CHECK(exists(path));
+    remove(path.c_str());
+}
+
+// ===== user-102: стан на момент часу =====
+TEST(asOfQueriesReturnHistoricalState) {
+    Library lib;
+    lib.addBook(PrintedBook(1, "A", Author("x"), 2000, "Drama", 10));
+    UserRow s = lib.addStudent("Ann", "CS", 1);
+    CHECK(lib.checkout(s, 1, 100));
+    CHECK(lib.checkin(s, 1, 200));
+    CHECK(lib.wasAvailable(1, 50));
+    CHECK(!lib.wasAvailable(1, 150));
+    CHECK(lib.wasAvailable(1, 250));
+    CHECK(lib.borrowedAt(s, 150) == 1);
+    CHECK(lib.borrowedAt(s, 250) == 0);
+}
+
+// ===== user-103: ліниві індекси дають ті самі результати, що й сканування =====
+TEST(lazyIndexesMatchScansAndSurviveEviction) {
+    Catalog c;
+    fillCatalog(c, 500);
+    auto expected = idsOf(c.search([](const Book& b) { return b.getAuthor().getName() == "Author 5"; }));
+    CHECK(idsOf(c.findBy(IndexField::Author, "Author 5")) == expected);   // сканування, побудова у фоні
+    c.waitForIndexBuilds();
+    CHECK(c.indexBytes() > 0);
+    CHECK(idsOf(c.findBy(IndexField::Author, "Author 5")) == expected);
+    c.evictIndexes(0);
+    CHECK(c.indexBytes() == 0);
+    c.startWarming({IndexField::Author, IndexField::Title});
+    CHECK(idsOf(c.findBy(IndexField::Author, "Author 5")) == expected);
+    c.waitForIndexBuilds();
+    fillCatalog(c, 10, 1000);
+    CHECK(c.findBy(IndexField::Title, "Title 3").size() == c.search([](const Book& b) { return b.getTitle() == "Title 3"; }).size());
+}
+
+// Межа пам'яті індексів спрацьовує сама: при побудові й додаванні книг скидаються найдавніші
+TEST(indexBudgetEvictsLeastRecentlyUsed) {
+    Catalog c;
+    fillCatalog(c, 500);
+    c.findBy(IndexField::Title, "Title 1");
+    c.waitForIndexBuilds();
+    size_t titleBytes = c.indexBytes();
+    c.findBy(IndexField::Author, "Author 1");
+    c.waitForIndexBuilds();
+    size_t bothBytes = c.indexBytes();
+    CHECK(titleBytes > 0 && bothBytes > titleBytes);
+    c.findBy(IndexField::Title, "Title 2");          // автор тепер найдавніше використаний
+    c.setIndexBudget(bothBytes - 1);
+    CHECK(c.indexBytes() == titleBytes);
+    CHECK(c.stats().indexEntries == 500);
+    c.findBy(IndexField::Author, "Author 1");        // перебудова витісняє заголовки
+    c.waitForIndexBuilds();
+    CHECK(c.indexBytes() == bothBytes - titleBytes);
+    fillCatalog(c, 200, 1000);
+    CHECK(c.indexBytes() <= bothBytes - 1);
+    auto expected = idsOf(c.search([](const Book& b) { return b.getAuthor().getName() == "Author 7"; }));
+    CHECK(idsOf(c.findBy(IndexField::Author, "Author 7")) == expected);
+}
+
+// Індекс, більший за всю межу, не будується: запити сканують без повторних спроб побудови
+TEST(indexLargerThanBudgetIsNotBuilt) {
+    Catalog c;
+    fillCatalog(c, 2000);
+    c.setIndexBudget(1024);
+    auto expected = idsOf(c.search([](const Book& b) { return b.getTitle() == "Title 4"; }));
+    for (int i = 0; i < 20; ++i) {
+        CHECK(idsOf(c.findBy(IndexField::Title, "Title 4")) == expected);
+        c.waitForIndexBuilds();
+    }
+    CHECK(c.indexBytes() == 0);
+    CHECK(c.stats().indexBuilds == 1);
+    c.setIndexBudget(SIZE_MAX);
+    c.findBy(IndexField::Title, "Title 4");
+    c.waitForIndexBuilds();
+    CHECK(c.indexBytes() > 0);
+    CHECK(idsOf(c.findBy(IndexField::Title, "Title 4")) == expected);
+}
+
+// ===== user-104: радикс-сортування збігається зі стабільним сортуванням =====
+TEST(radixSortMatchesStableSort) {
+    mt19937 rng(7);
+    vector<string> keys;
+    for (int i = 0; i < 150000; ++i) {
+        string k;
+        for (int n = rng() % 12; n > 0; --n) k += (char)('a' + rng() % 5);
+        keys.push_back(collationKey(k));
+    }
+    vector<size_t> expected(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) expected[i] = i;
+    stable_sort(expected.begin(), expected.end(), [&](size_t a, size_t b) { return keys[a] < keys[b]; });
+    CHECK(parallelRadixSort(keys) == expected);
+    CHECK(collationKey("  The  Hobbit, or There!") == "the hobbit or there");
+}
+
+// ===== user-105: журнал аудиту пишеться у файл =====
+TEST(auditLogWritesEntries) {
+    AuditConfig cfg;
+    cfg.prefix = "tests_audit";
+    {
+        AuditLog audit(cfg);
+        for (int i = 0; i < 1000; ++i) audit.record(AuditAction::Checkout, "user" + to_string(i % 10), i);
+    }
+    ifstream in("tests_audit.0.log", ios::binary);
+    string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    CHECK(data.size() > 1000);
+    CHECK(data.find("user7") != string::npos);
+    remove("tests_audit.0.log");
+}
+
+// Ротація всередині одного пакета, довгі імена без обрізання, межа втрат не перевищується
+TEST(auditLogRotatesMidBatchAndKeepsLongActors) {
+    AuditConfig cfg;
+    cfg.prefix = "tests_audit_rot";
+    cfg.rotateBytes = 256;
+    cfg.flushInterval = chrono::milliseconds(10000);     // усе піде одним пакетом при зупинці
+    string longActor(60, 'x');
+    longActor += "-tail";
+    {
+        AuditLog audit(cfg);
+        for (int i = 0; i < 500; ++i) audit.record(AuditAction::Checkin, i == 0 ? longActor : "u" + to_string(i), i);
+    }
+    size_t files = 0;
+    bool longFound = false, withinLimit = true;
+    for (;; ++files) {
+        string name = "tests_audit_rot." + to_string(files) + ".log";
+        ifstream in(name, ios::binary);
+        if (!in) break;
+        string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        if (data.find(longActor) != string::npos) longFound = true;
+        if (data.size() > cfg.rotateBytes + 80) withinLimit = false;
+        in.close();
+        remove(name.c_str());
+    }
+    CHECK(files > 5);
+    CHECK(withinLimit);
+    CHECK(longFound);
+
+    AuditConfig tight;
+    tight.prefix = "tests_audit_drop";
+    tight.bufferEntries = 2;
+    tight.maxDropped = 10;
+    tight.flushInterval = chrono::milliseconds(1);
+    size_t droppedSeen = 0;
+    {
+        AuditLog audit(tight);
+        vector<thread> threads;
+        for (int t = 0; t < 8; ++t)
+            threads.emplace_back([&audit] {
+                for (int i = 0; i < 2000; ++i) audit.record(AuditAction::Checkout, "d", i);
+            });
+        for (auto& t : threads) t.join();
+        droppedSeen = audit.droppedCount();
+    }
+    CHECK(droppedSeen <= tight.maxDropped);
+    for (int i = 0; i < 64; ++i) remove(("tests_audit_drop." + to_string(i) + ".log").c_str());
+}
+
+// Потік, що чергує два журнали, тримає по одному буферу на журнал
+TEST(auditLogKeepsOneBufferPerThreadAndLog) {
+    AuditConfig a, b;
+    a.prefix = "tests_audit_a";
+    b.prefix = "tests_audit_b";
+    string longActor(40, 'n');
+    {
+        AuditLog first(a), second(b);
+        for (int i = 0; i < 100; ++i) {
+            first.record(AuditAction::Checkout, longActor, i);
+            second.record(AuditAction::Checkin, longActor, i);
+        }
+        CHECK(first.bufferCount() == 1);
+        CHECK(second.bufferCount() == 1);
+    }
+    for (const char* name : {"tests_audit_a.0.log", "tests_audit_b.0.log"}) {
+        ifstream in(name, ios::binary);
+        string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        CHECK(data.find(longActor) != string::npos);
+        in.close();
+        remove(name);
+    }
+}
+
+// ===== user-106: фільтри Блума відсікають розділи без втрати результатів =====
+TEST(bloomFiltersPrunePartitions) {
+    PartitionedCatalog pc(8);
+    for (int i = 1; i <= 4000; ++i)
+        pc.addBook(PrintedBook(i, "Title " + to_string(i), Author("Author " + to_string(i % 50)), 2000, "Drama", 100));
+    CHECK(idsOf(pc.findBy(IndexField::Title, "Title 1234")) == vector<int>{1234});
+    CHECK(pc.findBy(IndexField::Author, "Author 7").size() == 80);
+    for (int i = 0; i < 200; ++i) pc.findBy(IndexField::Title, "Title " + to_string(i + 1));
+    CHECK(pc.averageFanOut() < 2.0);
+    BloomFilter f(100);
+    for (int i = 0; i < 100; ++i) f.add(to_string(i));
+    for (int i = 0; i < 100; ++i) CHECK(f.mayContain(to_string(i)));
+}
+
+// Перебудова фільтра під час паралельних пошуків: кожна вже додана книга знаходиться,
+// а сама перебудова не рахується як пошук
+TEST(bloomFilterRebuildIsSafeUnderConcurrentSearch) {
+    PartitionedCatalog pc(4);
+    const int total = 4000;
+    atomic<int> added{0}, misses{0};
+    auto searchesBefore = Metrics::instance().totals(Operation::Search).first;
+    for (int id = 1; id <= total; ++id)
+        pc.addBook(PrintedBook(id, "T" + to_string(id), Author("a" + to_string(id)), 2000, "Drama", 1));
+    CHECK(Metrics::instance().totals(Operation::Search).first == searchesBefore);
+
+    PartitionedCatalog live(4);
+    thread liveWriter([&] {
+        for (int id = 1; id <= total; ++id) {
+            live.addBook(PrintedBook(id, "T" + to_string(id), Author("a"), 2000, "Drama", 1));
+            added = id;
+        }
+    });
+    vector<thread> readers;
+    for (int r = 0; r < 3; ++r)
+        readers.emplace_back([&, r] {
+            mt19937 rng((unsigned)r);
+            while (added < total) {
+                int known = added;
+                if (known == 0) continue;
+                int id = 1 + (int)(rng() % known);
+                if (live.findBy(IndexField::Title, "T" + to_string(id)).empty()) misses++;
+            }
+        });
+    liveWriter.join();
+    for (auto& t : readers) t.join();
+    CHECK(misses == 0);
+
+    // Книга, яку вже видно за id, видно й через фільтр
+    PartitionedCatalog racing(2);
+    atomic<bool> done{false};
+    thread writer([&] {
+        for (int id = 1; id <= total; ++id) racing.addBook(PrintedBook(id, "R" + to_string(id), Author("a"), 2000, "Drama", 1));
+        done = true;
+    });
+    int falseNegatives = 0;
+    for (int id = 1; id <= total && !done;) {
+        if (!racing.findById(id)) continue;
+        if (racing.findBy(IndexField::Title, "R" + to_string(id)).empty()) falseNegatives++;
+        ++id;
+    }
+    writer.join();
+    CHECK(falseNegatives == 0);
+}
+
+// ===== user-107: жанри — однобайтові коди =====
+TEST(genreCodesRoundTrip) {
+    for (size_t g = 0; g < fixedGenreCount; ++g) CHECK(genreCode(fixedGenres[g]) == g + 1);
+    CHECK(genreCode("science fiction") == genreCode("Science Fiction"));
+    CHECK(genreCode("") == 0);
+    GenreCode custom = genreCode("Tests Custom Genre");
+    CHECK(custom > fixedGenreCount);
+    CHECK(genreName(custom) == "Tests Custom Genre");
+    CHECK(genreCode("TESTS CUSTOM GENRE") == custom);
+}
+
+// ===== user-108: пакетне читання збігається з поодиноким =====
+TEST(getManyMatchesFindById) {
+    Catalog c;
+    fillCatalog(c, 2000);
+    vector<int> ids;
+    for (int i = 0; i < 500; ++i) ids.push_back(i * 7 % 2300);   // частина id відсутня
+    vector<Book*> batch = c.getMany(ids);
+    for (size_t i = 0; i < ids.size(); ++i) CHECK(batch[i] == c.findById(ids[i]));
+}
+
+// ===== user-109: зонні карти не змінюють результат сканування =====
+TEST(zoneMapScanMatchesFullSearch) {
+    Catalog c;
+    fillCatalog(c, 3000);
+    ScanFilter f;
+    f.yearMin = 1990;
+    f.yearMax = 1995;
+    f.typeMask = 1 << (int)BookType::EBook;
+    f.genre = genreCode("Drama");
+    auto pred = [&f](const Book& b) {
+        return b.getYear() >= f.yearMin && b.getYear() <= f.yearMax && b.type() == BookType::EBook && b.getGenreCode() == f.genre;
+    };
+    auto expected = idsOf(c.search(pred));
+    CHECK(idsOf(c.scan(f)) == expected);
+    c.cluster();
+    CHECK(idsOf(c.scan(f)) == expected);
+    CHECK(c.findById(1234) && c.findById(1234)->getId() == 1234);
+}
+
+// ===== user-110: стиснені стовпці збігаються з прямим скануванням =====
+TEST(columnStoreMatchesScan) {
+    Catalog c;
+    fillCatalog(c, 2500);
+    c.findById(10)->borrow();
+    ScanFilter f;
+    f.yearMin = 1960;
+    f.yearMax = 1980;
+    f.typeMask = 1 << (int)BookType::Printed | 1 << (int)BookType::Audio;
+    ColumnStore store(c);
+    CHECK(store.size() == 2500);
+    vector<int> got = store.select(f);
+    sort(got.begin(), got.end());
+    CHECK(got == idsOf(c.scan(f)));
+    f.genre = genreCode("History");
+    got = store.select(f, true);
+    sort(got.begin(), got.end());
+    vector<int> expected = idsOf(c.search([&f](const Book& b) {
+        return b.getYear() >= f.yearMin && b.getYear() <= f.yearMax && b.type() != BookType::EBook
+               && b.getGenreCode() == f.genre && b.isAvailable();
+    }));
+    CHECK(got == expected);
+}
+
+// ===== user-111: ліміт позик тримається при конкурентних запитах між шардами =====
+TEST(shardedLibraryRespectsBorrowLimit) {
+    const size_t clients = 4;
+    ShardedLibrary sl(3, clients);
+    for (int id = 1; id <= 400; ++id) ShardedLibrary::wait(*sl.addBook(0, PrintedBook(id, "B", Author("a"), 2000, "Drama", 1)));
+    vector<int> users;
+    for (int i = 0; i < 20; ++i) {
+        shared_ptr<ShardedLibrary::Ticket> t;
+        users.push_back(sl.addStudent(0, "s" + to_string(i), "F", 1, &t));
+        ShardedLibrary::wait(*t);
+    }
+    atomic<int> granted{0};
+    vector<thread> pool;
+    for (size_t c = 0; c < clients; ++c)
+        pool.emplace_back([&, c] {
+            vector<shared_ptr<ShardedLibrary::Ticket>> tickets;
+            for (int k = 0; k < 100; ++k) tickets.push_back(sl.borrow(c, users[(c * 100 + k) % users.size()], (int)(c * 100 + k) + 1));
+            for (auto& t : tickets) if (ShardedLibrary::wait(*t)) granted++;
+        });
+    for (auto& t : pool) t.join();
+    CHECK(granted == 100);   // 20 студентів по 5 книг
+}
+
+// Повні кільця й квитки, які клієнт не чекає, не повинні губити повідомлення
+TEST(shardedLibrarySurvivesFullRingsAndDroppedTickets) {
+    ShardedLibrary sl(2, 1, 4);
+    for (int id = 1; id <= 500; ++id) sl.addBook(0, PrintedBook(id, "B", Author("a"), 2000, "Drama", 1));
+    int user = sl.addStudent(0, "s", "F", 1);
+    CHECK(ShardedLibrary::wait(*sl.borrow(0, user, 500)));
+    for (int id = 1; id <= 200; ++id) sl.borrow(0, user, id);
+    CHECK(!ShardedLibrary::wait(*sl.borrow(0, user, 499)));   // ліміт набрано, хоч квитки й відпущено
+}
+
+// Чужу книгу повернути не можна; простійні шарди не палять процесор
+TEST(shardedLibraryRejectsReturnsFromOtherUsers) {
+    ShardedLibrary sl(3, 1);
+    ShardedLibrary::wait(*sl.addBook(0, PrintedBook(7, "B", Author("a"), 2000, "Drama", 1)));
+    shared_ptr<ShardedLibrary::Ticket> t;
+    int a = sl.addStudent(0, "a", "F", 1, &t);
+    ShardedLibrary::wait(*t);
+    int b = sl.addStudent(0, "b", "F", 1, &t);
+    ShardedLibrary::wait(*t);
+    CHECK(ShardedLibrary::wait(*sl.borrow(0, a, 7)));
+    CHECK(!ShardedLibrary::wait(*sl.giveBack(0, b, 7)));
+    CHECK(!ShardedLibrary::wait(*sl.borrow(0, b, 7)));
+    CHECK(ShardedLibrary::wait(*sl.giveBack(0, a, 7)));
+    CHECK(!ShardedLibrary::wait(*sl.giveBack(0, a, 7)));
+    CHECK(ShardedLibrary::wait(*sl.borrow(0, b, 7)));
+
+    clock_t before = clock();
+    this_thread::sleep_for(chrono::milliseconds(300));
+    double cpu = (double)(clock() - before) / CLOCKS_PER_SEC;
+    CHECK(cpu < 0.1);
+    CHECK(ShardedLibrary::wait(*sl.giveBack(0, b, 7)));   // після сну шарди прокидаються
+}
+
+// ===== user-112: конвеєр мутацій =====
+TEST(mutationPipelineAppliesCommandsInOrder) {
+    Library lib;
+    ostringstream log;
+    mutex m;
+    map<uint64_t, bool> replies;
+    {
+        MutationPipeline p(lib, log, [&](uint64_t seq, bool ok, const string&) { lock_guard<mutex> l(m); replies[seq] = ok; });
+        p.submit("book|P|Dune|Herbert|1965|Science Fiction|412");
+        p.submit("student|Ann|CS|2");
+        p.submit("borrow|Ann|1");
+        p.submit("borrow|Ann|1");
+        p.submit("return|Ann|1");
+        p.submit("book|X|bad");
+        p.close();
+    }
+    CHECK(replies.size() == 6);
+    CHECK(replies[0] && replies[1] && replies[2] && !replies[3] && replies[4] && !replies[5]);
+    CHECK(log.str().find("2 borrow|Ann|1") != string::npos);
+}
+
+// Простійний конвеєр спить, а не крутить стадії; після сну команди проходять
+TEST(mutationPipelineSleepsWhenIdle) {
+    Library lib;
+    ostringstream log;
+    atomic<int> replies{0};
+    MutationPipeline p(lib, log, [&](uint64_t, bool, const string&) { replies++; });
+    clock_t before = clock();
+    this_thread::sleep_for(chrono::milliseconds(300));
+    double cpu = (double)(clock() - before) / CLOCKS_PER_SEC;
+    CHECK(cpu < 0.1);
+    p.submit("student|Ann|CS|2");
+    p.close();
+    CHECK(replies == 1);
+}
+
+// Числа поза діапазоном int відхиляються перевіркою, а не валять потік apply
+TEST(mutationPipelineRejectsOutOfRangeNumbers) {
+    Library lib;
+    ostringstream log;
+    mutex m;
+    map<uint64_t, string> errors;
+    {
+        MutationPipeline p(lib, log, [&](uint64_t seq, bool ok, const string& error) { lock_guard<mutex> l(m); errors[seq] = ok ? "" : error; });
+        p.submit("student|Ann|CS|2");
+        p.submit("borrow|Ann|99999999999");
+        p.submit("book|P|Dune|Herbert|1965|Drama|99999999999");
+        p.submit("student|Bob|CS|-99999999999");
+        p.submit("book|E|Dune|Herbert|1965|Drama|inf");
+        p.submit("book|P|Dune|Herbert|1965|Drama|412");
+        p.close();
+    }
+    CHECK(errors.size() == 6);
+    CHECK(errors[0].empty() && errors[5].empty());
+    for (uint64_t seq = 1; seq <= 4; ++seq) CHECK(errors[seq] == "malformed arguments");
+    CHECK(lib.getCatalog().findById(1) && lib.getCatalog().findById(1)->getTitle() == "Dune");
+}
+
+TEST(mutationPipelineKeepsCommandsWhenRingsFill) {
+    Library lib;
+    ostringstream log;
+    atomic<int> ok{0};
+    {
+        MutationPipeline p(lib, log, [&](uint64_t, bool success, const string&) { ok += success; }, 8, 4);
+        for (int i = 0; i < 2000; ++i) p.submit("student|s" + to_string(i) + "|F|1");
+        p.close();
+    }
+    CHECK(ok == 2000);
+    CHECK(lib.findUser("s1999") != noUser);
+}
+
+// ===== user-113: метрики у форматі Prometheus =====
+TEST(metricsRenderPrometheusText) {
+    Catalog c;
+    fillCatalog(c, 10);
+    {
+        GaugeRegistration gauges = registerCatalogGauges(c);
+        c.findById(3);
+        string text = Metrics::instance().render();
+        CHECK(text.find("library_books{tier=\"hot\"} 10") != string::npos);
+        CHECK(text.find("library_operation_seconds_bucket{op=\"search\",le=\"+Inf\"}") != string::npos);
+        CHECK(text.find("# TYPE library_residency_hits_total counter") != string::npos);
+        size_t expected = 0;
+        c.forEach([&](const Book& b) { expected += b.bytes(); });
+        CHECK(text.find("library_memory_bytes{component=\"books\"} " + to_string(expected) + "\n") != string::npos);
+        auto totals = Metrics::instance().totals(Operation::Search);
+        CHECK(totals.first > 0);
+    }
+    // Після знищення реєстрації збір більше не читає каталог
+    CHECK(Metrics::instance().render().find("library_books{") == string::npos);
+}
+
+// Новий потік реєструє свій шард метрик посеред збору: показник чекає на такий потік
+TEST(metricsNewThreadsDoNotWaitForScrape) {
+    Metrics& m = Metrics::instance();
+    GaugeRegistration reg(m.newGaugeGroup());
+    m.addGauge(reg.id(), "tests_thread_started", "Starts a thread during a scrape.", "", [] {
+        thread t([] { Metrics::instance().count(MetricCounter::QueryExecuted); });
+        t.join();
+        return 1.0;
+    });
+    CHECK(m.render().find("tests_thread_started 1\n") != string::npos);
+}
+
+// ===== user-114: профайлер пише folded-файл із семплами зайнятого циклу =====
+TEST(profilerStartsAndStops) {
+    SamplingProfiler p(4, 64);
+    bool started = p.start(999);
+#ifdef LIBRARY_PROFILER
+    CHECK(started);
+    auto end = chrono::steady_clock::now() + chrono::milliseconds(200);
+    volatile double x = 0;
+    while (chrono::steady_clock::now() < end) x += 1;
+    p.stop();
+    CHECK(!p.isRunning());
+    {
+        ofstream out("tests_profile.folded");
+        p.writeFolded(out);
+    }
+    // Кожен рядок — "кадр;кадр;... кількість"
+    ifstream in("tests_profile.folded");
+    string line;
+    size_t samples = 0, lines = 0;
+    while (getline(in, line)) {
+        size_t space = line.rfind(' ');
+        CHECK(space != string::npos && space > 0);
+        if (space == string::npos) continue;
+        samples += stoul(line.substr(space + 1));
+        lines++;
+    }
+    in.close();
+    remove("tests_profile.folded");
+    CHECK(lines > 0);
+    CHECK(samples > 0);
+#else
+    CHECK(!started);
+#endif
+}
+
+// ===== user-115: запит по підтипу збігається із загальним пошуком =====
+TEST(searchTypeMatchesGenericSearch) {
+    Catalog c;
+    fillCatalog(c, 900);
+    auto typed = c.searchType<AudioBook>([](const AudioBook& a) { return a.getDuration() > 10; });
+    auto generic = c.search([](const Book& b) {
+        return b.type() == BookType::Audio && static_cast<const AudioBook&>(b).getDuration() > 10;
+    });
+    CHECK(idsOf(typed) == idsOf(generic));
+}
+
+// ===== user-116: однакові запити в польоті виконуються один раз =====
+TEST(searchServiceCoalescesConcurrentQueries) {
+    Catalog c;
+    fillCatalog(c, 200);
+    SearchService service(c);
+    vector<thread> pool;
+    vector<SearchService::Result> results(16);
+    for (size_t i = 0; i < results.size(); ++i)
+        pool.emplace_back([&, i] { results[i] = service.find(IndexField::Title, " Title 5 "); });
+    for (auto& t : pool) t.join();
+    for (auto& r : results) CHECK(r && *r == *results[0]);
+    CHECK(results[0]->size() == c.findBy(IndexField::Title, "Title 5").size());
+}
+
+// Нова книга скидає кеш; запит, що почався до зміни, не кладе в кеш старий результат
+TEST(searchServiceSeesNewBooks) {
+    Catalog c;
+    fillCatalog(c, 200);
+    SearchService service(c, 1024, chrono::seconds(60));
+    size_t before = service.find(IndexField::Title, "Title 5")->size();
+    c.addBook(PrintedBook(1000, "Title 5", Author("a"), 2000, "Drama", 1));
+    CHECK(service.find(IndexField::Title, "Title 5")->size() == before + 1);
+
+    atomic<bool> done{false};
+    thread reader([&] { while (!done) service.find(IndexField::Title, "Fresh"); });
+    for (int id = 2000; id < 2300; ++id) c.addBook(PrintedBook(id, "Fresh", Author("a"), 2000, "Drama", 1));
+    done = true;
+    reader.join();
+    CHECK(service.find(IndexField::Title, "Fresh")->size() == 300);
+}
+
+// ===== user-117: статичний індекс Ейтцінгера =====
+TEST(eytzingerLowerBoundMatchesStd) {
+    mt19937 rng(3);
+    vector<pair<int, uint32_t>> entries;
+    for (uint32_t i = 0; i < 5000; ++i) entries.emplace_back((int)(rng() % 20000), i);
+    EytzingerIndex<int> index(entries);
+    vector<int> sorted;
+    for (auto& e : entries) sorted.push_back(e.first);
+    sort(sorted.begin(), sorted.end());
+    for (int x = -5; x < 20010; x += 3)
+        CHECK(index.lowerBound(x) == (size_t)(lower_bound(sorted.begin(), sorted.end(), x) - sorted.begin()));
+
+    Catalog c;
+    fillCatalog(c, 600);
+    c.freeze();
+    fillCatalog(c, 50, 1000);
+    auto range = c.yearRange(1960, 1965);
+    CHECK(range.size() == c.search([](const Book& b) { return b.getYear() >= 1960 && b.getYear() <= 1965; }).size());
+    CHECK(is_sorted(range.begin(), range.end(), [](Book* a, Book* b) { return a->getYear() < b->getYear(); }));
+}
+
+// ===== user-118: розтріскування дає ті самі діапазони, що й повне сканування =====
+TEST(crackingMatchesFullScan) {
+    Catalog c;
+    fillCatalog(c, 3000);
+    mt19937 rng(5);
+    for (int q = 0; q < 50; ++q) {
+        double lo = 50 + rng() % 900, hi = lo + rng() % 200;
+        auto expected = idsOf(c.searchType<PrintedBook>([&](const PrintedBook& p) { return p.getPages() >= lo && p.getPages() <= hi; }));
+        CHECK(idsOf(c.crackRange(NumericField::Pages, lo, hi)) == expected);
+        if (q == 25) fillCatalog(c, 30, 5000);
+    }
+}
+
+// ===== user-119: навчений індекс =====
+TEST(learnedIndexMatchesHashLookups) {
+    Catalog c;
+    fillCatalog(c, 5000);
+    c.useLearnedIndexes(true);
+    fillCatalog(c, 300, 10000);
+    for (int id : {1, 777, 5000, 10000, 10299, 4242}) CHECK(c.findById(id) && c.findById(id)->getId() == id);
+    CHECK(!c.findById(7777));
+    CHECK(idsOf(c.learnedYearRange(1990, 1992)) == idsOf(c.search([](const Book& b) { return b.getYear() >= 1990 && b.getYear() <= 1992; })));
+    CHECK(c.learnedModelBytes() > 0);
+}
+
+// ===== user-120: симулятор детермінований =====
+TEST(simulatorIsDeterministic) {
+    SimulationConfig cfg;
+    cfg.days = 20;
+    cfg.students = 200;
+    cfg.titles = 300;
+    SimulationReport a = LibrarySimulator(cfg).run(), b = LibrarySimulator(cfg).run();
+    CHECK(a.events == b.events && a.borrows == b.borrows && a.holdsPlaced == b.holdsPlaced);
+    CHECK(a.borrows > 0 && a.returns > 0);
+}
+
+// Порожні множини студентів чи назв не ламають розподіли; один студент не стає в чергу сам за собою
+TEST(simulatorHandlesDegenerateConfigs) {
+    SimulationConfig cfg;
+    cfg.days = 10;
+    cfg.students = 0;
+    cfg.titles = 0;
+    CHECK(LibrarySimulator(cfg).run().events > 0);
+    cfg.students = 1;
+    cfg.titles = 1;
+    SimulationReport r = LibrarySimulator(cfg).run();
+    CHECK(r.borrows > 0 && r.holdsPlaced == 0 && r.holdsFulfilled == 0);
+}
+
+TEST(checkoutHonoursHoldQueue) {
+    Library lib;
+    lib.addBook(PrintedBook(1, "A", Author("x"), 2000, "Drama", 10));
+    UserRow a = lib.addStudent("a", "F", 1), b = lib.addStudent("b", "F", 1), c = lib.addStudent("c", "F", 1);
+    CHECK(!lib.placeHold(b, 1));            // книга на полиці
+    CHECK(lib.checkout(a, 1));
+    CHECK(!lib.placeHold(a, 1));            // власник не резервує свою книгу
+    CHECK(lib.placeHold(b, 1) && lib.placeHold(c, 1) && !lib.placeHold(b, 1));
+    CHECK(!lib.checkin(b, 1));              // повертає лише той, хто взяв
+    CHECK(lib.checkin(a, 1));
+    CHECK(!lib.checkout(c, 1) && !lib.checkout(a, 1));
+    CHECK(lib.checkout(b, 1) && lib.nextHold(1) == c);
+    CHECK(lib.checkin(b, 1));
+    CHECK(lib.popHold(1) == c && lib.holdQueueLength(1) == 0);
+    CHECK(lib.checkout(a, 1));              // черга порожня — бере будь-хто
+}
+
+// ===== user-121: повнотекстовий пошук =====
+TEST(contentIndexFindsPhrases) {
+    Catalog c;
+    ofstream("tests_ebook_1.txt") << "It was a bright cold day in April";
+    ofstream("tests_ebook_2.txt") << "a cold bright day";
+    c.addBook(EBook(1, "One", Author("a"), 2000, "Drama", 1));
+    {
+        ContentIndex index(c, ".");
+        index.indexCatalog(2);
+        CHECK(index.phrase("bright cold").size() == 0);   // файли мають інший префікс
+    }
+    for (int id : {1, 2}) rename(("tests_ebook_" + to_string(id) + ".txt").c_str(), (to_string(id) + ".txt").c_str());
+    {
+        ContentIndex index(c, ".");
+        index.indexCatalog(2);
+        c.addBook(EBook(2, "Two", Author("a"), 2000, "Drama", 1));
+        index.waitIdle();
+        CHECK(index.phrase("bright cold day") == vector<int>{1});
+        CHECK(index.near("cold", "day", 1) == vector<int>{1});
+        CHECK(index.near("cold", "day", 2) == (vector<int>{1, 2}));
+        CHECK(index.near("april", "bright", 3).empty());
+    }
+    remove("1.txt");
+    remove("2.txt");
+}
+
+// Книга, файлу якої ще не було, індексується наступним проходом, коли файл з'явився
+TEST(contentIndexRetriesBooksWithoutFiles) {
+    Catalog c;
+    remove("2101.txt");
+    c.addBook(EBook(2101, "Late", Author("a"), 2000, "Drama", 1));
+    ContentIndex index(c, ".");
+    index.indexCatalog(1);
+    CHECK(index.phrase("late arrival").empty());
+    ofstream("2101.txt") << "a late arrival";
+    index.indexCatalog(1);
+    CHECK(index.phrase("late arrival") == vector<int>{2101});
+    index.indexCatalog(1);
+    CHECK(index.phrase("late arrival") == vector<int>{2101});   // уже проіндексовану книгу не дублює
+    remove("2101.txt");
+}
+
+// Книга, додана під час indexCatalog, потрапляє і до слухача, і в обхід каталогу;
+// індексується вона один раз, а злиття з двох потоків не дублюють сегменти
+TEST(contentIndexIndexesEachBookOnce) {
+    const int first = 1001, count = 200;
+    for (int id = first; id < first + count; ++id) ofstream(to_string(id) + ".txt") << "alpha beta gamma";
+    Catalog c;
+    for (int id = first; id < first + count / 2; ++id) c.addBook(EBook(id, "T", Author("a"), 2000, "Drama", 1));
+    {
+        ContentIndex index(c, ".", 2);
+        thread adder([&] {
+            for (int id = first + count / 2; id < first + count; ++id) c.addBook(EBook(id, "T", Author("a"), 2000, "Drama", 1));
+        });
+        index.indexCatalog(4);
+        adder.join();
+        index.waitIdle();
+        index.indexCatalog(4);
+        CHECK(index.documentsIndexed() == (uint64_t)count);
+        CHECK(index.phrase("alpha beta").size() == (size_t)count);
+        CHECK(index.near("alpha", "gamma", 2).size() == (size_t)count);
+        CHECK(index.segmentCount() <= 2);
+    }
+    for (int id = first; id < first + count; ++id) remove((to_string(id) + ".txt").c_str());
+}
+
+// ===== user-122: план переміщень мінімальної вартості =====
+TEST(transferPlannerFindsMinimumCost) {
+    vector<vector<TitleDemand>> branches(3);
+    branches[0].push_back(TitleDemand{"A", 5, 0});
+    branches[1].push_back(TitleDemand{"A", 0, 3});
+    branches[2].push_back(TitleDemand{"A", 0, 4});
+    TransferPlanner planner({{0, 1, 10}, {1, 0, 1}, {10, 1, 0}});
+    vector<Transfer> plan = planner.plan(branches, 2);
+    CHECK(plan.size() == 2);
+    CHECK(planner.totalCost(plan) == 23);
+
+    Library lib;
+    lib.addBook(PrintedBook(1, "X", Author("a"), 2000, "Drama", 1));
+    lib.addBook(PrintedBook(2, "X", Author("a"), 2000, "Drama", 1));
+    UserRow a = lib.addStudent("a", "F", 1);
+    UserRow b = lib.addStudent("b", "F", 1);
+    lib.checkout(a, 1);
+    lib.placeHold(b, 1);
+    vector<TitleDemand> d = lib.demandSnapshot();
+    CHECK(d.size() == 1 && d[0].available == 1 && d[0].holds == 1);
+}
+
+// ===== user-123: планувальник виконує задачі за пріоритетом =====
+TEST(maintenanceSchedulerRunsTasks) {
+    MaintenanceScheduler scheduler;
+    int critical = 0, idle = 0;
+    scheduler.submit("idle", MaintenancePriority::Idle, MaintenanceBudget(), [&](uint64_t&) { return ++idle < 10; });
+    scheduler.submit("critical", MaintenancePriority::Critical, MaintenanceBudget(), [&](uint64_t& io) { io += 10; return ++critical < 10; });
+    scheduler.waitIdle();
+    CHECK(critical == 10 && idle == 10);
+    for (auto& t : scheduler.stats()) CHECK(t.done && t.steps == 10);
+}
+
+// Задача, що вичерпала частку CPU, чекає поповнення, а не крутить планувальник
+TEST(throttledMaintenanceLeavesCpuIdle) {
+    atomic<bool> stop{false};
+    atomic<int> steps{0};
+    clock_t cpuBefore;
+    auto wallBefore = chrono::steady_clock::now();
+    {
+        MaintenanceScheduler scheduler;
+        MaintenanceBudget budget;
+        budget.cpuShare = 0.01;
+        cpuBefore = clock();
+        scheduler.submit("slow", MaintenancePriority::Normal, budget, [&](uint64_t&) {
+            auto end = chrono::steady_clock::now() + chrono::milliseconds(1);
+            while (chrono::steady_clock::now() < end) {}
+            steps++;
+            return !stop;
+        });
+        this_thread::sleep_for(chrono::milliseconds(500));
+        stop = true;
+    }
+    double cpuSec = double(clock() - cpuBefore) / CLOCKS_PER_SEC;
+    double wallSec = chrono::duration<double>(chrono::steady_clock::now() - wallBefore).count();
+    CHECK(steps > 0);
+    CHECK(cpuSec < 0.1 * wallSec);
+}
+
+// ===== user-124: таблиця користувачів =====
+TEST(userTableTracksLimits) {
+    Library lib;
+    for (int id = 1; id <= 8; ++id) lib.addBook(PrintedBook(id, "B", Author("a"), 2000, "Drama", 1));
+    UserRow s = lib.addStudent("s", "CS", 2);
+    UserRow l = lib.addLibrarian("l", "E1");
+    for (int id = 1; id <= 6; ++id) lib.checkout(s, id);
+    lib.checkout(l, 7);
+    UserView student = lib.user(s), librarian = lib.user(l);
+    CHECK(student.getBorrowed() == 5 && !student.canBorrow() && librarian.canBorrow());
+    CHECK(student.getName() == "s" && librarian.getName() == "l");
+    CHECK(student.role() == UserRole::Student && librarian.role() == UserRole::Librarian);
+    CHECK(!lib.user(noUser));
+    CHECK(lib.usersAtLimit().size() == 1 && lib.usersAtLimit()[0] == s);
+    lib.checkin(s, 1);
+    CHECK(lib.getUserTable().countAtLimit() == 0 && student.canBorrow());
+    CHECK(lib.findUser("l") == l && lib.findUser("nobody") == noUser);
+}
+
+// Фасад перевіряє ліміт рядка таблиці, а не вшитий ліміт студента
+TEST(userFacadeUsesTableLimit) {
+    UserTable table;
+    UserRow r = table.addStudent("s", "F", 1);
+    UserView s(table, r);
+    for (int i = 0; i < UserTable::studentLimit - 1; ++i) table.borrow(r);
+    CHECK(s.canBorrow() == table.canBorrow(r) && s.canBorrow());
+    table.borrow(r);
+    CHECK(s.canBorrow() == table.canBorrow(r) && !s.canBorrow());
+    unique_ptr<User> standalone = make_unique<Student>("t", "F", 1);   // видалення через базовий клас
+    CHECK(standalone->canBorrow());
+}
+
+// Індекс імен повертає перший рядок з іменем і переживає розширення
+TEST(userTableFindsNamesThroughIndex) {
+    UserTable table;
+    for (int i = 0; i < 5000; ++i) table.addStudent("user" + to_string(i), "F", 1);
+    UserRow dup = table.addLibrarian("user42", "E");
+    CHECK(table.find("user42") == 42 && dup == 5000);
+    CHECK(table.find("user4999") == 4999);
+    CHECK(table.find("user5000") == noUser && table.find("") == noUser);
+    CHECK(UserTable().find("x") == noUser);
+}
+
+// ===== user-125: читання з токеном бачать власні записи =====
+TEST(replicatedReadsSeeOwnWrites) {
+    ReplicatedLibrary rl(3, chrono::milliseconds(1), chrono::milliseconds(2));
+    ReadToken admin;
+    for (int id = 1; id <= 100; ++id) rl.addBook(PrintedBook(id, "B", Author("a"), 2000, "Drama", 1), admin);
+    atomic<int> violations{0};
+    vector<thread> pool;
+    for (int t = 0; t < 4; ++t)
+        pool.emplace_back([&, t] {
+            ReadToken token;
+            string name = "s" + to_string(t);
+            UserRow me = rl.addStudent(name, "F", 1, token);
+            for (int k = 0; k < 5; ++k) {
+                rl.checkout(me, t * 25 + k + 1, token);
+                int seen = rl.read(token, [&](const Library& lib) { return lib.getUserTable().contains(me) && lib.getUserTable().name(me) == name
+                                                                     ? lib.getUserTable().borrowedBy(me) : -1; });
+                if (seen != k + 1) violations++;
+            }
+        });
+    for (auto& t : pool) t.join();
+    CHECK(violations == 0);
+    CHECK(rl.readsOnFollowers() + rl.readsOnLeader() == 20);
+    // Записи, які застосували всі послідовники, з журналу прибираються
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(5);
+    while (rl.logEntries() > 0 && chrono::steady_clock::now() < deadline) this_thread::sleep_for(chrono::milliseconds(1));
+    CHECK(rl.logEntries() == 0);
+    for (size_t f = 0; f < rl.followerCount(); ++f) CHECK(rl.followerLag(f) == 0);
+    ReplicatedLibrary alone(0);
+    ReadToken t;
+    alone.addBook(PrintedBook(1, "B", Author("a"), 2000, "Drama", 1), t);
+    CHECK(alone.logEntries() == 0 && t.lsn == 1);
+}
+
+// Послідовник відтворює час мутацій лідера, а не час, коли до нього дійшов журнал
+TEST(followersKeepLeaderTimestamps) {
+    ReplicatedLibrary rl(1, chrono::milliseconds(1100), chrono::milliseconds(0));
+    ReadToken token;
+    rl.addBook(PrintedBook(1, "B", Author("a"), 2000, "Drama", 1), token);
+    UserRow first = rl.addStudent("same", "F", 1, token), second = rl.addStudent("same", "F", 1, token);
+    CHECK(first != second && second != noUser);
+    CHECK(rl.checkout(second, 1, token));
+    time_t t = time(nullptr);
+    while (rl.followerLag(0) > 0) this_thread::sleep_for(chrono::milliseconds(10));
+    bool consistent = rl.read(token, [&](const Library& lib) {
+        return !lib.wasAvailable(1, t) && lib.borrowedAt(second, t) == 1 && lib.borrowedAt(first, t) == 0;
+    });
+    CHECK(consistent);
+    CHECK(rl.readsOnFollowers() == 1);
+}
+
+}   // namespace
+
+int main(int argc, char** argv) {
+    size_t ran = 0;
+    for (const TestCase& t : registry()) {
+        if (argc > 1 && string(argv[1]) != t.name) continue;
+        int before = failures;
+        t.run();
+        ran++;
+        cout << (failures == before ? "[  OK  ] " : "[ FAIL ] ") << t.name << "\n";
+    }
+    cout << ran << " tests, " << failures << " failed checks\n";
+    return failures || ran == 0 ? 1 : 0;
+}